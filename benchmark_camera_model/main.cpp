@@ -0,0 +1,275 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+#include "camera_model_fixed_point.h"
+#include "camera_rig.h"
+#include "camera_trajectory.h"
+
+/*** Macro ***/
+static constexpr int32_t kWidth = 1280;
+static constexpr int32_t kHeight = 720;
+static constexpr float kFovDeg = 130.0f;
+static constexpr int32_t kPointNum = 1000000;
+static constexpr int32_t kLoopNum = 10;
+static constexpr int32_t kTimestampNum = 10000;
+static constexpr int32_t kCorrespondenceNum = 50000;
+
+
+/*** Function ***/
+static double MeasureMs(const std::function<void(void)>& func)
+{
+    /* Return the best time of kLoopNum runs */
+    func();     /* warm up (generate caches) */
+    double time_best = 1e9;
+    for (int32_t i = 0; i < kLoopNum; i++) {
+        const auto& t0 = std::chrono::steady_clock::now();
+        func();
+        const auto& t1 = std::chrono::steady_clock::now();
+        double time = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0;
+        time_best = (std::min)(time_best, time);
+    }
+    return time_best;
+}
+
+template <typename Scalar>
+static void ResetCamera(CameraModelT<Scalar>& camera)
+{
+    /* The same setting as distance_calculation */
+    camera.SetIntrinsic(kWidth, kHeight, FocalLength(kWidth, kFovDeg));
+    camera.SetDist({ Scalar(-0.1), Scalar(0.01), Scalar(-0.005), Scalar(-0.001), Scalar(0.0) });
+    camera.SetExtrinsic(
+        { 0, 0, 0 },    /* rvec [deg] */
+        { 0, Scalar(-1.5), 0 }, true);   /* tvec (Oc - Ow in world coordinate. X+= Right, Y+ = down, Z+ = far) */
+}
+
+template <typename Scalar>
+static void RunSpeedTest(const char* name)
+{
+    typedef typename CameraModelT<Scalar>::Point2 Point2;
+    typedef typename CameraModelT<Scalar>::Point3 Point3;
+
+    CameraModelT<Scalar> camera;
+    ResetCamera(camera);
+
+    /* Random points in front of the camera */
+    cv::RNG rng(1234);
+    std::vector<Point3> object_point_list(kPointNum);
+    for (auto& object_point : object_point_list) {
+        object_point.x = static_cast<Scalar>(rng.uniform(-20.0, 20.0));
+        object_point.y = static_cast<Scalar>(rng.uniform(-5.0, 5.0));
+        object_point.z = static_cast<Scalar>(rng.uniform(1.0, 100.0));
+    }
+    std::vector<Point2> image_point_list;
+    std::vector<Point3> object_point_in_camera_list;
+    std::vector<typename CameraModelT<Scalar>::Matx26> jacobian_pose_list;
+    std::vector<typename CameraModelT<Scalar>::Matx23> jacobian_point_list;
+
+    /* Image points on the lower half (ground) */
+    std::vector<Point2> ground_image_point_list;
+    for (int32_t y = kHeight / 2; y < kHeight; y += 4) {
+        for (int32_t x = 0; x < kWidth; x += 4) {
+            ground_image_point_list.push_back(Point2(static_cast<Scalar>(x), static_cast<Scalar>(y)));
+        }
+    }
+    std::vector<Point3> ground_object_point_list;
+
+    printf("[%s]\n", name);
+    printf("  ConvertWorld2Image (%d points)             : %8.3f [ms]\n", kPointNum, MeasureMs([&]() {
+        camera.ConvertWorld2Image(object_point_list, image_point_list);
+    }));
+    printf("  ConvertWorld2ImageJacobian (%d points)     : %8.3f [ms]\n", kPointNum, MeasureMs([&]() {
+        camera.ConvertWorld2ImageJacobian(object_point_list, image_point_list, jacobian_pose_list, jacobian_point_list);
+    }));
+    printf("  ConvertWorld2Camera (%d points)            : %8.3f [ms]\n", kPointNum, MeasureMs([&]() {
+        camera.ConvertWorld2Camera(object_point_list, object_point_in_camera_list);
+    }));
+    printf("  ConvertImage2GroundPlaneDirect (%d points)  : %8.3f [ms]\n", static_cast<int32_t>(ground_image_point_list.size()), MeasureMs([&]() {
+        camera.ConvertImage2GroundPlaneDirect(ground_image_point_list, ground_object_point_list);
+    }));
+    /* Points are modified, so this is the last one */
+    /* Rotation, then translation (composed in advance) */
+    typedef CameraModelT<Scalar> Camera;
+    typename Camera::Matx33 R;
+    typename Camera::Vec3 t;
+    Camera::ComposeTransform(Camera::MakeRotationMat(Scalar(1), Scalar(2), Scalar(3)), typename Camera::Vec3(0, 0, 0), Camera::Matx33::eye(), typename Camera::Vec3(1, 2, 3), R, t);
+    printf("  TransformObject (%d points)                : %8.3f [ms]\n", kPointNum, MeasureMs([&]() {
+        CameraModelT<Scalar>::TransformObject(R, t, object_point_list);
+    }));
+}
+
+template <typename Scalar>
+static void RunPrecisionTest(const char* name)
+{
+    typedef typename CameraModelT<Scalar>::Point2 Point2;
+    typedef typename CameraModelT<Scalar>::Point3 Point3;
+
+    /* Ground truth: project points on the ground plane with double, then convert them back with Scalar */
+    CameraModelD camera_ref;
+    ResetCamera(camera_ref);
+    CameraModelT<Scalar> camera;
+    ResetCamera(camera);
+
+    printf("[%s]\n", name);
+    printf("  Distance [m] | Error of ConvertImage2GroundPlane [m]\n");
+    for (double distance : { 10.0, 20.0, 50.0, 100.0, 200.0, 500.0 }) {
+        cv::Point2d image_point_ref;
+        camera_ref.ConvertWorld2Image(cv::Point3d(2.0, 0.0, distance), image_point_ref);
+
+        std::vector<Point2> image_point_list = { Point2(static_cast<Scalar>(image_point_ref.x), static_cast<Scalar>(image_point_ref.y)) };
+        std::vector<Point3> object_point_list;
+        camera.ConvertImage2GroundPlaneDirect(image_point_list, object_point_list);
+        const double error = std::sqrt(std::pow(object_point_list[0].x - 2.0, 2) + std::pow(object_point_list[0].z - distance, 2));
+        printf("  %12.1f | %.6f\n", distance, error);
+    }
+}
+
+static void RunTrajectoryTest(const char* name)
+{
+    /* Vehicle driving straight at 20 [m/s] while turning slowly, logged at 10 [Hz] for 60 [sec] */
+    CameraTrajectory trajectory;
+    for (int32_t i = 0; i <= 600; i++) {
+        const double timestamp = i * 0.1;
+        trajectory.AddPose(timestamp, Quaternion::FromRotationVector(0, Deg2Rad(timestamp), 0), cv::Vec3d(0, -1.5, 20.0 * timestamp));
+    }
+    std::vector<double> timestamp_list(kTimestampNum);
+    for (int32_t i = 0; i < kTimestampNum; i++) timestamp_list[i] = 60.0 * i / kTimestampNum;
+    std::vector<Quaternion> q_list;
+    std::vector<cv::Vec3d> T_list;
+
+    CameraModel camera;
+    ResetCamera(camera);
+
+    printf("[%s]\n", name);
+    printf("  CameraTrajectory::GetPose (%d timestamps)  : %8.3f [ms]\n", kTimestampNum, MeasureMs([&]() {
+        trajectory.GetPose(timestamp_list, q_list, T_list);
+    }));
+    printf("  CameraModel::SetPose (%d times)            : %8.3f [ms]\n", kTimestampNum, MeasureMs([&]() {
+        for (int32_t i = 0; i < kTimestampNum; i++) {
+            camera.SetPose(q_list[i], cv::Vec3f(static_cast<float>(T_list[i][0]), static_cast<float>(T_list[i][1]), static_cast<float>(T_list[i][2])));
+            camera.Prepare();
+        }
+    }));
+}
+
+static void RunTriangulationTest(const char* name)
+{
+    /* Stereo cameras (baseline = 0.3 [m]) see random points, and matched points have noise of 0.5 [px] */
+    CameraModel camera_left;
+    CameraModel camera_right;
+    ResetCamera(camera_left);
+    ResetCamera(camera_right);
+    camera_left.SetCameraPos(-0.15f, -1.5f, 0.0f);
+    camera_right.SetCameraPos(0.15f, -1.5f, 0.0f);
+    CameraRig camera_rig;
+    camera_rig.AddCamera(&camera_left);
+    camera_rig.AddCamera(&camera_right);
+
+    cv::RNG rng(1234);
+    std::vector<cv::Point3f> object_point_list(kCorrespondenceNum);
+    for (auto& object_point : object_point_list) {
+        object_point.x = static_cast<float>(rng.uniform(-5.0, 5.0));
+        object_point.y = static_cast<float>(rng.uniform(-3.0, 1.0));
+        object_point.z = static_cast<float>(rng.uniform(2.0, 30.0));
+    }
+    std::vector<std::vector<cv::Point2f>> image_point_list;
+    std::vector<std::vector<uint8_t>> is_visible_list;
+    camera_rig.ConvertWorld2Image(object_point_list, image_point_list, is_visible_list);
+    for (auto& image_point_list_of_camera : image_point_list) {
+        for (auto& image_point : image_point_list_of_camera) {
+            image_point.x += static_cast<float>(rng.gaussian(0.5));
+            image_point.y += static_cast<float>(rng.gaussian(0.5));
+        }
+    }
+
+    std::vector<cv::Point3f> triangulated_point_list;
+    std::vector<uint8_t> is_valid_list;
+    std::vector<float> error_list;
+    printf("[%s]\n", name);
+    for (int32_t refine_iteration : { 0, 3 }) {
+        const double time = MeasureMs([&]() {
+            camera_rig.Triangulate(image_point_list, triangulated_point_list, is_valid_list, &error_list, refine_iteration);
+        });
+        double depth_error = 0;
+        int32_t valid_num = 0;
+        for (int32_t i = 0; i < kCorrespondenceNum; i++) {
+            if (!is_valid_list[i] || !is_visible_list[0][i] || !is_visible_list[1][i]) continue;
+            depth_error += std::abs(triangulated_point_list[i].z - object_point_list[i].z) / object_point_list[i].z;
+            valid_num++;
+        }
+        printf("  Triangulate (%d points, refine = %d)    : %8.3f [ms], depth error = %.3f [%%]\n", kCorrespondenceNum, refine_iteration, time, 100.0 * depth_error / (std::max)(valid_num, 1));
+    }
+}
+
+static void RunFixedPointTest(const char* name)
+{
+    /* Random points in front of the camera, on Q16 grid so that both paths get the same input */
+    CameraModelD camera;
+    ResetCamera(camera);
+    CameraModelFixedPoint camera_fixed_point;
+    if (!camera_fixed_point.Create(camera)) return;
+
+    cv::RNG rng(1234);
+    std::vector<cv::Point3i> object_point_fixed_list(kPointNum);
+    std::vector<cv::Point3d> object_point_list(kPointNum);
+    for (int32_t i = 0; i < kPointNum; i++) {
+        object_point_fixed_list[i].x = CameraModelFixedPoint::ToFixed(rng.uniform(-20.0, 20.0));
+        object_point_fixed_list[i].y = CameraModelFixedPoint::ToFixed(rng.uniform(-5.0, 5.0));
+        object_point_fixed_list[i].z = CameraModelFixedPoint::ToFixed(rng.uniform(1.0, 100.0));
+        object_point_list[i].x = CameraModelFixedPoint::ToDouble(object_point_fixed_list[i].x);
+        object_point_list[i].y = CameraModelFixedPoint::ToDouble(object_point_fixed_list[i].y);
+        object_point_list[i].z = CameraModelFixedPoint::ToDouble(object_point_fixed_list[i].z);
+    }
+    std::vector<cv::Point2d> image_point_list;
+    std::vector<cv::Point> image_point_fixed_list;
+
+    printf("[%s]\n", name);
+    printf("  ConvertWorld2Image (%d points)             : %8.3f [ms]\n", kPointNum, MeasureMs([&]() {
+        camera_fixed_point.ConvertWorld2Image(object_point_fixed_list, image_point_fixed_list);
+    }));
+    camera.ConvertWorld2Image(object_point_list, image_point_list);
+    double error_max = 0;
+    for (int32_t i = 0; i < kPointNum; i++) {
+        if (image_point_list[i].x < 0 || image_point_list[i].x >= kWidth || image_point_list[i].y < 0 || image_point_list[i].y >= kHeight) continue;
+        error_max = (std::max)(error_max, std::abs(image_point_fixed_list[i].x - image_point_list[i].x));
+        error_max = (std::max)(error_max, std::abs(image_point_fixed_list[i].y - image_point_list[i].y));
+    }
+    printf("  Max error versus double (inside the image) : %8.3f [px] (including rounding to integer)\n", error_max);
+}
+
+
+int main(int argc, char* argv[])
+{
+    RunSpeedTest<float>("Speed: float");
+    RunSpeedTest<double>("Speed: double");
+    RunPrecisionTest<float>("Precision: float");
+    RunPrecisionTest<double>("Precision: double");
+    RunTrajectoryTest("Trajectory");
+    RunTriangulationTest("Triangulation");
+    RunFixedPointTest("Fixed point");
+    return 0;
+}
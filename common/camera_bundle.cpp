@@ -0,0 +1,302 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+#include "camera_bundle.h"
+
+/*** Macro ***/
+static constexpr char kMagic[8] = { 'C', 'A', 'M', 'B', 'N', 'D', 'L', '\0' };
+static constexpr uint64_t kAlignment = 64;
+
+/*** File format ***/
+/* Parameters are stored in double regardless of Scalar of CameraModel */
+struct BundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       /* sizeof(BundleHeader) */
+    uint32_t projection;        /* 0 = PinholeProjection, 1 = UnifiedProjection */
+    uint32_t table_num;
+    int32_t width;
+    int32_t height;
+    double K[9];
+    double dist_coeff[5];
+    double xi;
+    double rvec[3];             /* [rad] */
+    double tvec[3];             /* Ow - Oc in camera coordinate */
+};
+
+struct TableEntry {
+    uint32_t id;
+    int32_t param;
+    int32_t rows;
+    int32_t cols;
+    int32_t type;               /* cv::Mat::type() */
+    uint32_t reserved;
+    uint64_t offset;            /* from the beginning of the file */
+    uint64_t size;              /* [Byte] */
+};
+
+static_assert(sizeof(BundleHeader) == 200, "Layout of BundleHeader is changed. Increment kVersion");
+static_assert(sizeof(TableEntry) == 40, "Layout of TableEntry is changed. Increment kVersion");
+
+static uint64_t Align(uint64_t value)
+{
+    return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+
+/*** Memory mapped file (read only) ***/
+class CameraBundle::MappedFile {
+public:
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool Open(const std::string& filename)
+    {
+#ifdef _WIN32
+        file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) return false;
+        size_ = static_cast<size_t>(file_size.QuadPart);
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return false;
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        return data_ != nullptr;
+#else
+        fd_ = open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) return false;
+        size_ = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED) return false;
+        data_ = static_cast<const uint8_t*>(data);
+        return true;
+#endif
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+
+/*** Function ***/
+template <typename Scalar, typename Projection>
+bool CameraBundle::Save(const std::string& filename, const CameraModelT<Scalar, Projection>& camera, const std::vector<Table>& table_list)
+{
+    BundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.header_size = sizeof(BundleHeader);
+    header.projection = Projection::kIsUnified ? 1 : 0;
+    header.table_num = static_cast<uint32_t>(table_list.size());
+    header.width = camera.GetWidth();
+    header.height = camera.GetHeight();
+    for (int32_t i = 0; i < 9; i++) header.K[i] = camera.GetK().val[i];
+    for (int32_t i = 0; i < 5; i++) header.dist_coeff[i] = camera.GetDistCoeff()[i];
+    header.xi = camera.GetXi();
+    for (int32_t i = 0; i < 3; i++) header.rvec[i] = camera.GetRvec()[i];
+    for (int32_t i = 0; i < 3; i++) header.tvec[i] = camera.GetTvec()[i];
+
+    /* Tables must be continuous to be written at once (and to be used as Mat after mmap) */
+    std::vector<cv::Mat> mat_list;
+    std::vector<TableEntry> entry_list;
+    uint64_t offset = Align(sizeof(BundleHeader) + sizeof(TableEntry) * table_list.size());
+    for (const auto& table : table_list) {
+        if (table.mat.empty() || table.mat.dims != 2) {
+            printf("[CameraBundle::Save] Invalid table: %u\n", table.id);
+            return false;
+        }
+        cv::Mat mat = table.mat.isContinuous() ? table.mat : table.mat.clone();
+        TableEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.id = table.id;
+        entry.param = table.param;
+        entry.rows = mat.rows;
+        entry.cols = mat.cols;
+        entry.type = mat.type();
+        entry.offset = offset;
+        entry.size = static_cast<uint64_t>(mat.total() * mat.elemSize());
+        offset = Align(offset + entry.size);
+        entry_list.push_back(entry);
+        mat_list.push_back(mat);
+    }
+
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        printf("[CameraBundle::Save] Unable to open %s\n", filename.c_str());
+        return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!entry_list.empty()) ofs.write(reinterpret_cast<const char*>(entry_list.data()), sizeof(TableEntry) * entry_list.size());
+    static const char kPadding[kAlignment] = { 0 };
+    for (size_t i = 0; i < entry_list.size(); i++) {
+        const uint64_t current = static_cast<uint64_t>(ofs.tellp());
+        ofs.write(kPadding, static_cast<std::streamsize>(entry_list[i].offset - current));
+        ofs.write(reinterpret_cast<const char*>(mat_list[i].data), static_cast<std::streamsize>(entry_list[i].size));
+    }
+    if (!ofs) {
+        printf("[CameraBundle::Save] Unable to write %s\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CameraBundle::Open(const std::string& filename)
+{
+    Close();
+    std::shared_ptr<MappedFile> mapped_file = std::make_shared<MappedFile>();
+    if (!mapped_file->Open(filename)) {
+        printf("[CameraBundle::Open] Unable to open %s\n", filename.c_str());
+        return false;
+    }
+
+    /* Validate the header and all entries here, so that accessors don't need to check them */
+    const uint8_t* data = mapped_file->data();
+    const size_t size = mapped_file->size();
+    if (size < sizeof(BundleHeader)) {
+        printf("[CameraBundle::Open] Invalid file size\n");
+        return false;
+    }
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(data);
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->header_size != sizeof(BundleHeader)) {
+        printf("[CameraBundle::Open] Not a camera bundle: %s\n", filename.c_str());
+        return false;
+    }
+    if (header->version != kVersion) {
+        printf("[CameraBundle::Open] Unsupported version: %u (expected %u)\n", header->version, kVersion);
+        return false;
+    }
+    if (sizeof(BundleHeader) + sizeof(TableEntry) * static_cast<uint64_t>(header->table_num) > size) {
+        printf("[CameraBundle::Open] Invalid table num\n");
+        return false;
+    }
+    const TableEntry* entry_list = reinterpret_cast<const TableEntry*>(data + sizeof(BundleHeader));
+    for (uint32_t i = 0; i < header->table_num; i++) {
+        const TableEntry& entry = entry_list[i];
+        const uint64_t expected_size = static_cast<uint64_t>(entry.rows) * entry.cols * CV_ELEM_SIZE(entry.type);
+        if (entry.rows <= 0 || entry.cols <= 0 || entry.size != expected_size || entry.offset % kAlignment != 0 || entry.offset > size || entry.size > size - entry.offset) {
+            printf("[CameraBundle::Open] Invalid table: %u\n", entry.id);
+            return false;
+        }
+    }
+
+    mapped_file_ = mapped_file;
+    return true;
+}
+
+void CameraBundle::Close()
+{
+    /* The memory is unmapped when all cameras using the tables are released */
+    mapped_file_.reset();
+}
+
+cv::Mat CameraBundle::GetTable(uint32_t id, int32_t* param) const
+{
+    if (!mapped_file_) return cv::Mat();
+    const uint8_t* data = mapped_file_->data();
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(data);
+    const TableEntry* entry_list = reinterpret_cast<const TableEntry*>(data + sizeof(BundleHeader));
+    for (uint32_t i = 0; i < header->table_num; i++) {
+        const TableEntry& entry = entry_list[i];
+        if (entry.id != id) continue;
+        if (param) *param = entry.param;
+        return cv::Mat(entry.rows, entry.cols, entry.type, const_cast<uint8_t*>(data + entry.offset));
+    }
+    return cv::Mat();
+}
+
+template <typename Scalar, typename Projection>
+bool CameraBundle::Apply(CameraModelT<Scalar, Projection>& camera) const
+{
+    if (!mapped_file_) return false;
+    const BundleHeader* header = reinterpret_cast<const BundleHeader*>(mapped_file_->data());
+    if (header->projection != (Projection::kIsUnified ? 1u : 0u)) {
+        printf("[CameraBundle::Apply] Projection model doesn't match\n");
+        return false;
+    }
+
+    camera.SetIntrinsic(header->width, header->height,
+        static_cast<Scalar>(header->K[0]), static_cast<Scalar>(header->K[4]), static_cast<Scalar>(header->K[2]), static_cast<Scalar>(header->K[5]));
+    camera.SetDist({ static_cast<Scalar>(header->dist_coeff[0]), static_cast<Scalar>(header->dist_coeff[1]), static_cast<Scalar>(header->dist_coeff[2]),
+        static_cast<Scalar>(header->dist_coeff[3]), static_cast<Scalar>(header->dist_coeff[4]) });
+    camera.SetXi(static_cast<Scalar>(header->xi));
+    camera.SetExtrinsic(
+        { static_cast<Scalar>(Rad2Deg(header->rvec[0])), static_cast<Scalar>(Rad2Deg(header->rvec[1])), static_cast<Scalar>(Rad2Deg(header->rvec[2])) },
+        { static_cast<Scalar>(header->tvec[0]), static_cast<Scalar>(header->tvec[1]), static_cast<Scalar>(header->tvec[2]) }, false);
+
+    /* Tables which don't match (e.g. saved by CameraModel with a different Scalar) are generated by the camera as usual */
+    const cv::Mat ray_table = GetTable(kTableRay);
+    if (!ray_table.empty()) camera.SetRayTable(ray_table, mapped_file_);
+    int32_t subsample = 0;
+    const cv::Mat ground_plane_map = GetTable(kTableGroundPlane, &subsample);
+    if (!ground_plane_map.empty()) camera.SetGroundPlaneMap(ground_plane_map, subsample, mapped_file_);
+    return true;
+}
+
+
+/*** Explicit instantiation ***/
+/* Must be after all the definitions */
+template bool CameraBundle::Save(const std::string&, const CameraModelT<float, PinholeProjection>&, const std::vector<Table>&);
+template bool CameraBundle::Save(const std::string&, const CameraModelT<double, PinholeProjection>&, const std::vector<Table>&);
+template bool CameraBundle::Save(const std::string&, const CameraModelT<float, UnifiedProjection>&, const std::vector<Table>&);
+template bool CameraBundle::Save(const std::string&, const CameraModelT<double, UnifiedProjection>&, const std::vector<Table>&);
+template bool CameraBundle::Apply(CameraModelT<float, PinholeProjection>&) const;
+template bool CameraBundle::Apply(CameraModelT<double, PinholeProjection>&) const;
+template bool CameraBundle::Apply(CameraModelT<float, UnifiedProjection>&) const;
+template bool CameraBundle::Apply(CameraModelT<double, UnifiedProjection>&) const;
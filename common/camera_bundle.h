@@ -0,0 +1,83 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CAMERA_BUNDLE_
+#define CAMERA_BUNDLE_
+
+/*** Include ***/
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+/***
+* Binary bundle of camera parameters and precomputed tables (calibration result)
+*   File layout (little endian):
+*     Header | TableEntry x table_num | table data (each table is aligned to 64 Byte)
+*   The file is opened with mmap (MapViewOfFile on Windows), and tables are used without copy and parse,
+*   so loading is done in milliseconds even for full HD remap / ray tables
+*   The version is incremented when the layout is changed. Files with a different version are rejected
+***/
+class CameraBundle {
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    enum TableId : uint32_t {
+        kTableUndistortMapX = 1,    /* CV_32FC1, for cv::remap. param = 0 */
+        kTableUndistortMapY = 2,    /* CV_32FC1, for cv::remap. param = 0 */
+        kTableRay = 3,              /* CameraModelT::GetRayTable. param = 0 */
+        kTableGroundPlane = 4,      /* CameraModelT::GetGroundPlaneMap. param = subsample */
+    };
+
+    struct Table {
+        uint32_t id;
+        int32_t param;
+        cv::Mat mat;
+    };
+
+public:
+    CameraBundle() {}
+    ~CameraBundle() { Close(); }
+    CameraBundle(const CameraBundle&) = delete;
+    CameraBundle& operator=(const CameraBundle&) = delete;
+
+    /* Save parameters of the camera and tables (e.g. { kTableRay, 0, camera.GetRayTable() }) */
+    template <typename Scalar, typename Projection>
+    static bool Save(const std::string& filename, const CameraModelT<Scalar, Projection>& camera, const std::vector<Table>& table_list);
+
+    bool Open(const std::string& filename);
+    void Close();
+    bool IsOpened() const { return mapped_file_ != nullptr; }
+
+    /***
+    * Table in the mapped file (read only, don't write)
+    *   Empty Mat if the table doesn't exist
+    *   The memory is valid while the bundle is opened, or while a camera which uses the table by Apply is alive
+    ***/
+    cv::Mat GetTable(uint32_t id, int32_t* param = nullptr) const;
+
+    /* Set parameters to the camera, and let the camera use tables in the bundle (ray table, ground plane map) */
+    template <typename Scalar, typename Projection>
+    bool Apply(CameraModelT<Scalar, Projection>& camera) const;
+
+private:
+    class MappedFile;
+    std::shared_ptr<MappedFile> mapped_file_;
+};
+
+#endif
@@ -0,0 +1,1623 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <limits>
+
+#include <opencv2/opencv.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+
+/*** Methods for camera parameters ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetIntrinsic(int32_t width, int32_t height, Scalar focal_length)
+{
+    width_ = width;
+    height_ = height;
+    K_ = Matx33(
+        focal_length, 0, width / Scalar(2),
+        0, focal_length, height / Scalar(2),
+        0, 0, 1);
+    UpdateNewCameraMatrix();
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetIntrinsic(int32_t width, int32_t height, Scalar fx, Scalar fy, Scalar cx, Scalar cy)
+{
+    width_ = width;
+    height_ = height;
+    K_ = Matx33(
+        fx, 0, cx,
+        0, fy, cy,
+        0, 0, 1);
+    UpdateNewCameraMatrix();
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetFocalLength(Scalar fx, Scalar fy)
+{
+    if (this->fx() == fx && this->fy() == fy) return;
+    K_(0, 0) = fx;
+    K_(1, 1) = fy;
+    UpdateNewCameraMatrix();
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetDist(const std::array<Scalar, 5>& dist)
+{
+    if (GetDist() == dist) return;
+    dist_coeff_ = cv::Vec<Scalar, 5>(dist[0], dist[1], dist[2], dist[3], dist[4]);
+    UpdateNewCameraMatrix();
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetXi(Scalar xi)
+{
+    if (xi_ == xi) return;
+    xi_ = xi;
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetUndistortionCriteria(int32_t max_iteration, Scalar epsilon)
+{
+    if (undistortion_max_iteration_ == max_iteration && undistortion_epsilon_ == epsilon) return;
+    undistortion_max_iteration_ = max_iteration;
+    undistortion_epsilon_ = epsilon;
+    InvalidateDerivedState();   /* to re-generate the ground plane map */
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UpdateNewCameraMatrix()
+{
+    cv::Mat K_new = cv::getOptimalNewCameraMatrix(K_, dist_coeff_, cv::Size(width_, height_), 0.0);
+    K_new_ = Matx33(K_new);
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetRollingShutter(const std::array<Scalar, 3>& linear_velocity, const std::array<Scalar, 3>& angular_velocity_deg, Scalar line_readout_time)
+{
+    this->linear_velocity_ = Vec3(linear_velocity[0], linear_velocity[1], linear_velocity[2]);
+    this->angular_velocity_ = Vec3(Deg2Rad(angular_velocity_deg[0]), Deg2Rad(angular_velocity_deg[1]), Deg2Rad(angular_velocity_deg[2]));
+    this->line_readout_time_ = (std::max)(line_readout_time, Scalar(0));
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetExtrinsic(const std::array<Scalar, 3>& rvec_deg, const std::array<Scalar, 3>& tvec, bool is_t_on_world)
+{
+    rvec_ = Vec3(Deg2Rad(rvec_deg[0]), Deg2Rad(rvec_deg[1]), Deg2Rad(rvec_deg[2]));
+    this->q_ = Quaternion::FromRotationVector(rvec_[0], rvec_[1], rvec_[2]);
+    tvec_ = Vec3(tvec[0], tvec[1], tvec[2]);
+
+    /*
+        is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
+        is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
+    */
+    if (is_t_on_world) {
+        const Matx33 R(this->q_.ToRotationMatrix());
+        tvec_ = -(R * tvec_);   /* t = -RT */
+    }
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::GetExtrinsic(std::array<Scalar, 3>& rvec_deg, std::array<Scalar, 3>& tvec, bool is_t_on_world) const
+{
+    rvec_deg = { Rad2Deg(rvec_[0]), Rad2Deg(rvec_[1]) , Rad2Deg(rvec_[2]) };
+    /*
+        is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
+        is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
+    */
+    if (is_t_on_world) {
+        /* t = -RT -> T = -R^1 t */
+        const Vec3 T = GetCameraPosOnWorld();
+        tvec = { T[0], T[1], T[2] };
+    } else {
+        tvec = { tvec_[0], tvec_[1], tvec_[2] };
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetCameraPos(Scalar tx, Scalar ty, Scalar tz, bool is_on_world)    /* Oc - Ow */
+{
+    Vec3 tvec_new(tx, ty, tz);
+    if (is_on_world) {
+        const Matx33 R(this->q_.ToRotationMatrix());
+        tvec_new = -(R * tvec_new);   /* t = -RT */
+    } else {
+        /* Oc - Ow -> Ow - Oc */
+        tvec_new = -tvec_new;
+    }
+    if (tvec_new == tvec_) return;
+    tvec_ = tvec_new;
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::MoveCameraPos(Scalar dtx, Scalar dty, Scalar dtz, bool is_on_world)    /* Oc - Ow */
+{
+    Vec3 tvec_delta(dtx, dty, dtz);
+    if (is_on_world) {
+        const Matx33 R(this->q_.ToRotationMatrix());
+        tvec_delta = -(R * tvec_delta);
+    } else {
+        /* Oc - Ow -> Ow - Oc */
+        tvec_delta = -tvec_delta;
+    }
+    tvec_ += tvec_delta;
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetCameraAngle(Scalar pitch_deg, Scalar yaw_deg, Scalar roll_deg)
+{
+    if (Rad2Deg(rx()) == pitch_deg && Rad2Deg(ry()) == yaw_deg && Rad2Deg(rz()) == roll_deg) return;
+
+    /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
+    Vec3 T = GetCameraPosOnWorld();      /* T is tvec in world coordinate.  t = -RT */
+    rvec_ = Vec3(Deg2Rad(pitch_deg), Deg2Rad(yaw_deg), Deg2Rad(roll_deg));
+    this->q_ = Quaternion::FromRotationVector(rvec_[0], rvec_[1], rvec_[2]);
+    const Matx33 R_new(this->q_.ToRotationMatrix());
+    tvec_ = -(R_new * T);   /* t = -RT */
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::RotateCameraAngle(Scalar dpitch_deg, Scalar dyaw_deg, Scalar droll_deg)
+{
+    /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
+    Vec3 T = GetCameraPosOnWorld();      /* T is tvec in world coordinate.  t = -RT */
+    const Quaternion q_delta = Quaternion::FromRotationVector(Deg2Rad(static_cast<double>(dpitch_deg)), Deg2Rad(static_cast<double>(dyaw_deg)), Deg2Rad(static_cast<double>(droll_deg)));
+    SetPose(q_delta * this->q_, T);
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::SetPose(const Quaternion& q, const Vec3& T)
+{
+    this->q_ = q.Normalized();
+    double rx, ry, rz;
+    this->q_.ToRotationVector(rx, ry, rz);
+    rvec_ = Vec3(static_cast<Scalar>(rx), static_cast<Scalar>(ry), static_cast<Scalar>(rz));
+    const Matx33 R(this->q_.ToRotationMatrix());
+    tvec_ = -(R * T);   /* t = -RT */
+    InvalidateDerivedState();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::GetPose(Quaternion& q, Vec3& T) const
+{
+    q = this->q_;
+    T = GetCameraPosOnWorld();
+}
+
+
+/*** Methods for projection ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2Image(const Point3& object_point, Point2& image_point) const
+{
+    const DerivedState& state = GetDerivedState();
+    const ProjectionParameter& param = state.projection_param;
+    const RowPose* row_pose_list = state.row_pose_list.empty() ? nullptr : state.row_pose_list.data();
+    if (param.has_distortion) {
+        ProjectKernel<true, 3, 2>(param, row_pose_list, &object_point.x, &object_point.y, &object_point.z, &image_point.x, &image_point.y, 0, 1);
+    } else {
+        ProjectKernel<false, 3, 2>(param, row_pose_list, &object_point.x, &object_point.y, &object_point.z, &image_point.x, &image_point.y, 0, 1);
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2Image(const std::vector<Point3>& object_point_list, std::vector<Point2>& image_point_list) const
+{
+    /*** Mw -> Image ***/
+    /* the followings get exactly the same result */
+#if 1
+    image_point_list.resize(object_point_list.size());
+    if (object_point_list.empty()) return;
+
+    /* Point3 / Point2 are processed in place as strided arrays (x, y, z, x, y, z, ...) */
+    const Point3* src = object_point_list.data();
+    Point2* dst = image_point_list.data();
+    const DerivedState& state = GetDerivedState();
+    const RowPose* row_pose_list = state.row_pose_list.empty() ? nullptr : state.row_pose_list.data();
+    ProjectBatch<3, 2>(state.projection_param, row_pose_list, &src->x, &src->y, &src->z, &dst->x, &dst->y, static_cast<int32_t>(object_point_list.size()));
+#else
+    cv::projectPoints(object_point_list, rvec_, tvec_, K_, dist_coeff_, image_point_list);
+#endif
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2Image(const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, int32_t num, Scalar* u_list, Scalar* v_list) const
+{
+    /*** Mw -> Image (structure of arrays) ***/
+    /* The same calculation as the above, but each coordinate is stored in its own contiguous array */
+    if (num <= 0) return;
+    const DerivedState& state = GetDerivedState();
+    const RowPose* row_pose_list = state.row_pose_list.empty() ? nullptr : state.row_pose_list.data();
+    ProjectBatch<1, 1>(state.projection_param, row_pose_list, x_list, y_list, z_list, u_list, v_list, num);
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2ImageBlock(const Point3* object_point_list, int32_t num, Point2* image_point_list, Scalar* depth_list) const
+{
+    if (num <= 0) return;
+    const DerivedState& state = GetDerivedState();
+    const ProjectionParameter& param = state.projection_param;
+    const RowPose* row_pose_list = state.row_pose_list.empty() ? nullptr : state.row_pose_list.data();
+    const Point3* src = object_point_list;
+    Point2* dst = image_point_list;
+    if (depth_list) {
+        if (param.has_distortion) {
+            ProjectKernel<true, 3, 2, true>(param, row_pose_list, &src->x, &src->y, &src->z, &dst->x, &dst->y, 0, num, depth_list);
+        } else {
+            ProjectKernel<false, 3, 2, true>(param, row_pose_list, &src->x, &src->y, &src->z, &dst->x, &dst->y, 0, num, depth_list);
+        }
+    } else {
+        if (param.has_distortion) {
+            ProjectKernel<true, 3, 2>(param, row_pose_list, &src->x, &src->y, &src->z, &dst->x, &dst->y, 0, num);
+        } else {
+            ProjectKernel<false, 3, 2>(param, row_pose_list, &src->x, &src->y, &src->z, &dst->x, &dst->y, 0, num);
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2ImageJacobian(const std::vector<Point3>& object_point_list, std::vector<Point2>& image_point_list,
+    std::vector<Matx26>& jacobian_pose_list, std::vector<Matx23>& jacobian_point_list, std::vector<Matx29>* jacobian_intrinsic_list) const
+{
+    const int32_t num = static_cast<int32_t>(object_point_list.size());
+    image_point_list.resize(num);
+    jacobian_pose_list.resize(num);
+    jacobian_point_list.resize(num);
+    if (jacobian_intrinsic_list) jacobian_intrinsic_list->resize(num);
+    if (num == 0) return;
+
+    const ProjectionParameter& param = GetDerivedState().projection_param;
+    Matx29* jacobian_intrinsic = jacobian_intrinsic_list ? jacobian_intrinsic_list->data() : nullptr;
+
+    /* The same block split as ProjectBatch */
+    static constexpr int32_t kBlockSize = 4096;
+    const int32_t block_num = (num + kBlockSize - 1) / kBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t block = 0; block < block_num; block++) {
+        const int32_t offset = block * kBlockSize;
+        const int32_t size = (std::min)(kBlockSize, num - offset);
+        if (param.has_distortion) {
+            JacobianKernel<true>(param, object_point_list.data(), image_point_list.data(), jacobian_pose_list.data(), jacobian_point_list.data(), jacobian_intrinsic, offset, size);
+        } else {
+            JacobianKernel<false>(param, object_point_list.data(), image_point_list.data(), jacobian_pose_list.data(), jacobian_point_list.data(), jacobian_intrinsic, offset, size);
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertWorld2Camera(const std::vector<Point3>& object_point_in_world_list, std::vector<Point3>& object_point_in_camera_list) const
+{
+    /*** Mw -> Mc ***/
+    /* Mc = [R t] * [M, 1] = R * M + t */
+    const Matx33& R = GetDerivedState().R;
+    const Vec3& t = tvec_;
+
+    object_point_in_camera_list.resize(object_point_in_world_list.size());
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < object_point_in_world_list.size(); i++) {
+        const auto& object_point_in_world = object_point_in_world_list[i];
+        auto& object_point_in_camera = object_point_in_camera_list[i];
+        Vec3 Mw(object_point_in_world.x, object_point_in_world.y, object_point_in_world.z);
+        Vec3 Mc = R * Mw + t;
+        object_point_in_camera.x = Mc[0];
+        object_point_in_camera.y = Mc[1];
+        object_point_in_camera.z = Mc[2];
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertCamera2World(const std::vector<Point3>& object_point_in_camera_list, std::vector<Point3>& object_point_in_world_list) const
+{
+    /*** Mc -> Mw ***/
+    /* Mc = [R t] * [Mw, 1] */
+    /* -> [M, 1] = [R t]^1 * Mc <- Unable to get the inverse of [R t] because it's 4x3 */
+    /* So, Mc = R * Mw + t */
+    /* -> Mw = R^1 * (Mc - t) */
+    const Matx33& R_inv = GetDerivedState().R_inv;
+    const Vec3& t = tvec_;
+
+    object_point_in_world_list.resize(object_point_in_camera_list.size());
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < object_point_in_camera_list.size(); i++) {
+        const auto& object_point_in_camera = object_point_in_camera_list[i];
+        auto& object_point_in_world = object_point_in_world_list[i];
+        Vec3 Mc(object_point_in_camera.x, object_point_in_camera.y, object_point_in_camera.z);
+        Vec3 Mw = R_inv * (Mc - t);
+        object_point_in_world.x = Mw[0];
+        object_point_in_world.y = Mw[1];
+        object_point_in_world.z = Mw[2];
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2GroundPlane(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list)
+{
+    if (ground_plane_map_subsample_ > 0) {
+        ConvertImage2GroundPlaneByMap(image_point_list, object_point_list);
+    } else {
+        ConvertImage2GroundPlaneDirect(image_point_list, object_point_list);
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::EnableGroundPlaneMap(int32_t subsample)
+{
+    ground_plane_map_subsample_ = (std::max)(1, subsample);
+    ground_plane_map_.release();
+    ground_plane_map_storage_.reset();
+    UpdateParameterVersion();
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::DisableGroundPlaneMap()
+{
+    ground_plane_map_subsample_ = 0;
+    ground_plane_map_.release();
+    ground_plane_map_storage_.reset();
+    UpdateParameterVersion();
+}
+
+template <typename Scalar, typename Projection>
+const cv::Mat& CameraModelT<Scalar, Projection>::GetGroundPlaneMap()
+{
+    GetDerivedState();
+    if (ground_plane_map_.empty() || ground_plane_map_version_ != derived_state_version_) {
+        UpdateGroundPlaneMap();
+        ground_plane_map_version_ = derived_state_version_;
+    }
+    return ground_plane_map_;
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2GroundPlaneDirect(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list) const
+{
+    /*** Image -> Mw ***/
+    /*** Calculate point in ground plane (in world coordinate) ***/
+    /* Main idea:*/
+    /*   s * [x, y, 1] = K * [R t] * [M, 1]  */
+    /*   s * [x, y, 1] = K * R * M + K * t */
+    /*   s * Kinv * [x, y, 1] = R * M + t */
+    /*   s * Kinv * [x, y, 1] - t = R * M */
+    /*   Rinv * (s * Kinv * [x, y, 1] - t) = M */
+    /* calculate s */
+    /*   s * Rinv * Kinv * [x, y, 1] = M + R_inv * t */
+    /*      where, M = (X, Y, Z), and we assume Y = 0(ground_plane) */
+    /*      so , we can solve left[1] = R_inv * t[1](camera_height) */
+    /* Kinv * [x, y, 1] (= ray) is calculated by ConvertImage2Ray, which also removes distortion */
+
+    if (image_point_list.size() == 0) return;
+
+    const DerivedState& state = GetDerivedState();
+    const int32_t row_max = state.projection_param.row_num - 1;
+
+    /*** Undistort image point ***/
+    std::vector<Point2> ray_list;
+    ConvertImage2Ray(image_point_list, ray_list);
+
+    object_point_list.resize(image_point_list.size());
+    for (int32_t i = 0; i < object_point_list.size(); i++) {
+        auto& object_point = object_point_list[i];
+
+        /* Rolling shutter: the row of the image point is known, so just use the pose of the row */
+        const RowPose* pose = nullptr;
+        if (row_max >= 0) {
+            const Scalar y = image_point_list[i].y;
+            pose = &state.row_pose_list[y > 0 ? (std::min)(static_cast<int32_t>(y + Scalar(0.5)), row_max) : 0];
+        }
+        const Matx33& R_inv = pose ? pose->R_inv : state.R_inv;
+        const Vec3& t = pose ? pose->tvec : tvec_;
+        const Scalar right_wo_m = pose ? pose->R_inv_t[1] : state.R_inv_t[1];    /* no need to add M because M[1] = 0 (ground plane)*/
+
+        Vec3 XY(ray_list[i].x, ray_list[i].y, 1);
+
+        /* calculate s */
+        Vec3 LEFT_WO_S = R_inv * XY;
+        Scalar s = right_wo_m / LEFT_WO_S[1];
+        if (!(s > 0)) {
+            /* above the horizon (or no ray) */
+            object_point.x = 999;
+            object_point.y = 999;
+            object_point.z = 999;
+            continue;
+        }
+
+        /* calculate M */
+        Vec3 TEMP = R_inv * (XY * s - t);
+
+        object_point.x = TEMP[0];
+        object_point.y = TEMP[1];
+        object_point.z = TEMP[2];
+        if (object_point.z < 0) object_point.z = 999;
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2Plane(const std::vector<Point2>& image_point_list, const std::vector<Vec4>& plane_list,
+    std::vector<std::vector<Point3>>& object_point_list, std::vector<std::vector<uint8_t>>& is_hit_list) const
+{
+    /*** Image -> Mw ***/
+    /* Mw = T + s * Rinv * ray (T = camera position = -Rinv * t) */
+    /* n . Mw + d = 0  ->  s = -(n . T + d) / (n . (Rinv * ray)) = -(n . T + d) / ((R * n) . ray) */
+    /* (R * n) and -(n . T + d) are constants of each plane */
+    const int32_t point_num = static_cast<int32_t>(image_point_list.size());
+    const int32_t plane_num = static_cast<int32_t>(plane_list.size());
+    object_point_list.resize(plane_num);
+    is_hit_list.resize(plane_num);
+    for (int32_t p = 0; p < plane_num; p++) {
+        object_point_list[p].resize(point_num);
+        is_hit_list[p].resize(point_num);
+    }
+    if (point_num == 0 || plane_num == 0) return;
+
+    const DerivedState& state = GetDerivedState();
+    const int32_t row_max = state.projection_param.row_num - 1;
+
+    /*** Undistort image point ***/
+    std::vector<Point2> ray_list;
+    ConvertImage2Ray(image_point_list, ray_list);
+
+    const Scalar inf = std::numeric_limits<Scalar>::infinity();
+    for (int32_t p = 0; p < plane_num; p++) {
+        const Vec3 n(plane_list[p][0], plane_list[p][1], plane_list[p][2]);
+        const Scalar d = plane_list[p][3];
+        Vec3 n_c = state.R * n;
+        Scalar numerator = n.dot(state.R_inv_t) - d;     /* T = -R_inv_t */
+        Point3* object_point = object_point_list[p].data();
+        uint8_t* is_hit = is_hit_list[p].data();
+        for (int32_t i = 0; i < point_num; i++) {
+            /* Rolling shutter: the pose depends on the row of the image point, so the plane constants are calculated for each point */
+            const RowPose* pose = nullptr;
+            if (row_max >= 0) {
+                const Scalar y = image_point_list[i].y;
+                pose = &state.row_pose_list[y > 0 ? (std::min)(static_cast<int32_t>(y + Scalar(0.5)), row_max) : 0];
+                n_c = pose->R_inv.t() * n;
+                numerator = n.dot(pose->R_inv_t) - d;
+            }
+            const Matx33& R_inv = pose ? pose->R_inv : state.R_inv;
+            const Vec3& R_inv_t = pose ? pose->R_inv_t : state.R_inv_t;
+
+            const Vec3 ray(ray_list[i].x, ray_list[i].y, 1);
+            const Scalar s = numerator / n_c.dot(ray);
+            if (s > 0 && s < inf) {     /* false for NaN (no ray) and for the ray parallel to the plane */
+                const Vec3 M = R_inv * ray * s - R_inv_t;
+                object_point[i] = Point3(M[0], M[1], M[2]);
+                is_hit[i] = 1;
+            } else {
+                object_point[i] = Point3(0, 0, 0);
+                is_hit[i] = 0;
+            }
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2GroundPlaneByMap(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list)
+{
+    /*** Image -> Mw using the ground plane map ***/
+    if (image_point_list.size() == 0) return;
+
+    typedef cv::Vec<Scalar, 3> MapElement;
+    const cv::Mat& map = GetGroundPlaneMap();
+    const Scalar scale = Scalar(1) / ground_plane_map_subsample_;
+    const int32_t grid_x_max = map.cols - 2;
+    const int32_t grid_y_max = map.rows - 2;
+    const Scalar x_max = static_cast<Scalar>(width_ - 1);
+    const Scalar y_max = static_cast<Scalar>(height_ - 1);
+
+    /* Distance from the camera (on the ground) to check the change in a cell */
+    Quaternion q;
+    Vec3 T;
+    GetPose(q, T);
+    const Scalar cam_x = T[0];
+    const Scalar cam_z = T[2];
+    const Scalar ratio2_max = kGroundPlaneMapDistanceRatio * kGroundPlaneMapDistanceRatio;
+
+    std::vector<int32_t> outside_index_list;
+    object_point_list.resize(image_point_list.size());
+    for (int32_t i = 0; i < object_point_list.size(); i++) {
+        const auto& image_point = image_point_list[i];
+        auto& object_point = object_point_list[i];
+        if (!(image_point.x >= 0 && image_point.y >= 0 && image_point.x <= x_max && image_point.y <= y_max)) {
+            outside_index_list.push_back(i);
+            continue;
+        }
+
+        const Scalar gx = image_point.x * scale;
+        const Scalar gy = image_point.y * scale;
+        const int32_t ix = (std::min)(static_cast<int32_t>(gx), grid_x_max);
+        const int32_t iy = (std::min)(static_cast<int32_t>(gy), grid_y_max);
+        const MapElement* p0 = map.ptr<MapElement>(iy) + ix;
+        const MapElement* p1 = map.ptr<MapElement>(iy + 1) + ix;
+        if (p0[0][2] == 0 || p0[1][2] == 0 || p1[0][2] == 0 || p1[1][2] == 0) {
+            /* The cell crosses the horizon */
+            outside_index_list.push_back(i);
+            continue;
+        }
+        Scalar d2_min = std::numeric_limits<Scalar>::max();
+        Scalar d2_max = 0;
+        for (const MapElement* p : { p0, p0 + 1, p1, p1 + 1 }) {
+            const Scalar dx = (*p)[0] - cam_x;
+            const Scalar dz = (*p)[1] - cam_z;
+            d2_min = (std::min)(d2_min, dx * dx + dz * dz);
+            d2_max = (std::max)(d2_max, dx * dx + dz * dz);
+        }
+        if (d2_max > d2_min * ratio2_max) {
+            /* Near the horizon, the distance changes too much in the cell to interpolate */
+            outside_index_list.push_back(i);
+            continue;
+        }
+
+        /* Bilinear interpolation */
+        const Scalar ax = gx - ix;
+        const Scalar ay = gy - iy;
+        const MapElement v = (p0[0] * (1 - ax) + p0[1] * ax) * (1 - ay) + (p1[0] * (1 - ax) + p1[1] * ax) * ay;
+        object_point.x = v[0];
+        object_point.y = 0;
+        object_point.z = v[1];
+    }
+
+    /* Points outside the image or near the horizon */
+    if (!outside_index_list.empty()) {
+        std::vector<Point2> outside_image_point_list;
+        for (int32_t index : outside_index_list) outside_image_point_list.push_back(image_point_list[index]);
+        std::vector<Point3> outside_object_point_list;
+        ConvertImage2GroundPlaneDirect(outside_image_point_list, outside_object_point_list);
+        for (int32_t i = 0; i < outside_index_list.size(); i++) object_point_list[outside_index_list[i]] = outside_object_point_list[i];
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2Camera(const std::vector<Point2>& image_point_list, const std::vector<Scalar>& z_list, std::vector<Point3>& object_point_list)
+{
+    /*** Image -> Mc ***/
+    if (image_point_list.size() == 0) {
+        /* Convert for all pixels on image, when image_point_list = empty */
+        if (z_list.size() != width_ * height_) {
+            printf("[ConvertImage2Camera] Invalid z_list size\n");
+            return;
+        }
+        /* Mc = Zc * ray (ray table is cached, so no undistortion here) */
+        const cv::Vec<Scalar, 2>* ray_list = GetRayTable().template ptr<cv::Vec<Scalar, 2>>();
+        object_point_list.resize(z_list.size());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t i = 0; i < object_point_list.size(); i++) {
+            const Scalar Zc = z_list[i];
+            auto& object_point = object_point_list[i];
+            object_point.x = Zc * ray_list[i][0];
+            object_point.y = Zc * ray_list[i][1];
+            object_point.z = Zc;
+        }
+        return;
+    }
+
+    /* Convert for the input pixels only */
+    if (z_list.size() != image_point_list.size()) {
+        printf("[ConvertImage2Camera] Invalid z_list size\n");
+        return;
+    }
+
+    /*** Undistort image point ***/
+    std::vector<Point2> ray_list;
+    ConvertImage2Ray(image_point_list, ray_list);
+
+    object_point_list.resize(image_point_list.size());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < object_point_list.size(); i++) {
+        const auto& Zc = z_list[i];
+        auto& object_point = object_point_list[i];
+        object_point.x = Zc * ray_list[i].x;
+        object_point.y = Zc * ray_list[i].y;
+        object_point.z = Zc;
+    }
+}
+
+template <typename Scalar, typename Projection>
+const cv::Mat& CameraModelT<Scalar, Projection>::GetRayTable()
+{
+    IntrinsicKey key = MakeIntrinsicKey();
+    if (ray_table_.empty() || !(ray_table_key_ == key)) {
+        UpdateRayTable();
+        ray_table_key_ = key;
+    }
+    return ray_table_;
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::CopyTo(CameraModelT& dst) const
+{
+    if (&dst == this) return;
+
+    /* Keep the buffers of dst. They can be written only if dst is the only owner (not shared with a copy or external memory) */
+    cv::Mat ray_table_buffer = dst.ray_table_;
+    cv::Mat ground_plane_map_buffer = dst.ground_plane_map_;
+    dst.ray_table_.release();
+    dst.ground_plane_map_.release();
+    if (dst.ray_table_storage_ || (ray_table_buffer.u && ray_table_buffer.u->refcount > 1)) ray_table_buffer.release();
+    if (dst.ground_plane_map_storage_ || (ground_plane_map_buffer.u && ground_plane_map_buffer.u->refcount > 1)) ground_plane_map_buffer.release();
+
+    /* Parameters and derived state (std::vector members reuse the capacity of dst) */
+    dst = *this;
+
+    /* Tables: copied into the buffers of dst (allocated only if the size is changed) */
+    dst.ray_table_storage_.reset();
+    dst.ground_plane_map_storage_.reset();
+    if (ray_table_.empty()) {
+        dst.ray_table_.release();
+    } else {
+        ray_table_.copyTo(ray_table_buffer);
+        dst.ray_table_ = ray_table_buffer;
+    }
+    if (ground_plane_map_.empty()) {
+        dst.ground_plane_map_.release();
+    } else {
+        ground_plane_map_.copyTo(ground_plane_map_buffer);
+        dst.ground_plane_map_ = ground_plane_map_buffer;
+    }
+}
+
+template <typename Scalar, typename Projection>
+bool CameraModelT<Scalar, Projection>::SetRayTable(const cv::Mat& ray_table, const std::shared_ptr<const void>& storage)
+{
+    if (ray_table.rows != height_ || ray_table.cols != width_ || ray_table.type() != CV_MAKETYPE(kMatDepth, 2) || !ray_table.isContinuous()) {
+        printf("[SetRayTable] Invalid table\n");
+        return false;
+    }
+    ray_table_ = ray_table;
+    ray_table_storage_ = storage;
+    ray_table_key_ = MakeIntrinsicKey();
+    UpdateParameterVersion();
+    return true;
+}
+
+template <typename Scalar, typename Projection>
+bool CameraModelT<Scalar, Projection>::SetGroundPlaneMap(const cv::Mat& ground_plane_map, int32_t subsample, const std::shared_ptr<const void>& storage)
+{
+    const int32_t grid_width = (width_ - 1) / (std::max)(1, subsample) + 2;
+    const int32_t grid_height = (height_ - 1) / (std::max)(1, subsample) + 2;
+    if (subsample < 1 || ground_plane_map.rows != grid_height || ground_plane_map.cols != grid_width || ground_plane_map.type() != CV_MAKETYPE(kMatDepth, 3)) {
+        printf("[SetGroundPlaneMap] Invalid map\n");
+        return false;
+    }
+    GetDerivedState();
+    ground_plane_map_subsample_ = subsample;
+    ground_plane_map_ = ground_plane_map;
+    ground_plane_map_storage_ = storage;
+    ground_plane_map_version_ = derived_state_version_;
+    UpdateParameterVersion();
+    return true;
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2World(const std::vector<Point2>& image_point_list, const std::vector<Scalar>& z_list, std::vector<Point3>& object_point_list)
+{
+    /*** Image -> Mw ***/
+    std::vector<Point3> object_point_in_camera_list;
+    ConvertImage2Camera(image_point_list, z_list, object_point_in_camera_list);
+    ConvertCamera2World(object_point_in_camera_list, object_point_list);
+}
+
+
+/*** Extrinsic refinement ***/
+template <typename Scalar, typename Projection>
+Scalar CameraModelT<Scalar, Projection>::RefineExtrinsicOnGround(const std::vector<Point2>& image_point_list, const std::vector<Point3>& object_point_list, const std::vector<std::vector<Point2>>& lane_list, int32_t max_iteration)
+{
+    /***
+    * Parameters: p = (dpitch, height, c_0, c_1, ...)
+    *   R = Rx(dpitch) * R0 (rotation around X axis of the camera, the same as RotateCameraAngle)
+    *   T = (Tx, -height, Tz)  (Y+ = down)
+    * Point residual: normalized projection of Mw - observed ray
+    *   Mc = R * (Mw - T), (x, y) = (Xc / Zc, Yc / Zc)
+    *   dMc/ddpitch = [ex]x * Mc = (0, -Zc, Yc)  ->  dx/ddpitch = -x * y, dy/ddpitch = -(1 + y * y)
+    *   dMc/dheight = R * (0, 1, 0)
+    * Lane residual: lateral position of the intersection of the ray and the ground, per height
+    *   d = R^T * ray, g = dx / dy (Xw = Tx + height * g), r = w * (g - c_k)
+    *   dd/ddpitch = -R^T * [ex]x * ray
+    *   w = dy / dz at the initial pose (~= height / distance), so that the residual is comparable with the point residual
+    ***/
+    static constexpr double kMinDepth = 1e-6;
+    const int32_t point_num = static_cast<int32_t>((std::min)(image_point_list.size(), object_point_list.size()));
+    const int32_t lane_num = static_cast<int32_t>(lane_list.size());
+    const int32_t param_num = 2 + lane_num;
+    const bool refine_height = point_num > 0;
+
+    Quaternion q0;
+    Vec3 T0;
+    GetPose(q0, T0);
+    const cv::Matx33d R0 = q0.ToRotationMatrix();
+
+    /*** Undistort observations only once ***/
+    std::vector<Point2> ray_list;
+    ConvertImage2Ray(image_point_list, ray_list);
+
+    std::vector<Point2> lane_point_list;
+    std::vector<int32_t> lane_index_list;
+    for (int32_t k = 0; k < lane_num; k++) {
+        lane_point_list.insert(lane_point_list.end(), lane_list[k].begin(), lane_list[k].end());
+        lane_index_list.insert(lane_index_list.end(), lane_list[k].size(), k);
+    }
+    std::vector<Point2> lane_ray_list;
+    ConvertImage2Ray(lane_point_list, lane_ray_list);
+
+    /* Weight of each lane point and the initial lateral position of each lane (mean of g) */
+    std::vector<double> param(param_num, 0);
+    param[1] = -static_cast<double>(T0[1]);
+    std::vector<double> lane_weight_list(lane_ray_list.size(), 0);
+    std::vector<int32_t> lane_point_num_list(lane_num, 0);
+    for (int32_t i = 0; i < static_cast<int32_t>(lane_ray_list.size()); i++) {
+        const cv::Vec3d d = R0.t() * cv::Vec3d(lane_ray_list[i].x, lane_ray_list[i].y, 1);
+        if (!(d[1] > kMinDepth) || !(d[2] > kMinDepth)) continue;   /* above the horizon (or no ray) */
+        lane_weight_list[i] = d[1] / d[2];
+        param[2 + lane_index_list[i]] += d[0] / d[1];
+        lane_point_num_list[lane_index_list[i]]++;
+    }
+    for (int32_t k = 0; k < lane_num; k++) {
+        if (lane_point_num_list[k] > 0) param[2 + k] /= lane_point_num_list[k];
+    }
+
+    /*** Cost, J^T * J and J^T * r at p ***/
+    auto evaluate = [&](const std::vector<double>& p, std::vector<double>& JtJ, std::vector<double>& Jtr, int32_t& residual_num) {
+        std::fill(JtJ.begin(), JtJ.end(), 0.0);
+        std::fill(Jtr.begin(), Jtr.end(), 0.0);
+        residual_num = 0;
+        double cost = 0;
+
+        /* A residual depends on 2 parameters at most (col0, col1) */
+        auto accumulate = [&](int32_t col0, double j0, int32_t col1, double j1, double r) {
+            JtJ[col0 * param_num + col0] += j0 * j0;
+            JtJ[col0 * param_num + col1] += j0 * j1;
+            JtJ[col1 * param_num + col0] += j0 * j1;
+            JtJ[col1 * param_num + col1] += j1 * j1;
+            Jtr[col0] += j0 * r;
+            Jtr[col1] += j1 * r;
+            cost += r * r;
+            residual_num++;
+        };
+
+        const double cos_p = std::cos(p[0]);
+        const double sin_p = std::sin(p[0]);
+        const cv::Matx33d Rx(
+            1, 0, 0,
+            0, cos_p, -sin_p,
+            0, sin_p, cos_p);
+        const cv::Matx33d R = Rx * R0;
+        const cv::Matx33d R_inv = R.t();
+        const cv::Vec3d T(T0[0], -p[1], T0[2]);
+
+        for (int32_t i = 0; i < point_num; i++) {
+            const Point2& ray = ray_list[i];
+            const Point3& object_point = object_point_list[i];
+            const cv::Vec3d Mc = R * (cv::Vec3d(object_point.x, object_point.y, object_point.z) - T);
+            if (!(Mc[2] > kMinDepth) || std::isnan(ray.x)) continue;
+            const double z_inv = 1 / Mc[2];
+            const double x = Mc[0] * z_inv;
+            const double y = Mc[1] * z_inv;
+            const double jx_h = refine_height ? z_inv * (R(0, 1) - x * R(2, 1)) : 0;
+            const double jy_h = refine_height ? z_inv * (R(1, 1) - y * R(2, 1)) : 0;
+            accumulate(0, -x * y, 1, jx_h, x - ray.x);
+            accumulate(0, -(1 + y * y), 1, jy_h, y - ray.y);
+        }
+
+        for (int32_t i = 0; i < static_cast<int32_t>(lane_ray_list.size()); i++) {
+            const double w = lane_weight_list[i];
+            if (w == 0) continue;
+            const cv::Vec3d ray(lane_ray_list[i].x, lane_ray_list[i].y, 1);
+            const cv::Vec3d d = R_inv * ray;
+            if (!(d[1] > kMinDepth)) continue;
+            const cv::Vec3d dd = -(R_inv * cv::Vec3d(0, -ray[2], ray[1]));
+            const double dy_inv = 1 / d[1];
+            const double g = d[0] * dy_inv;
+            const double j_pitch = w * (dd[0] * d[1] - d[0] * dd[1]) * dy_inv * dy_inv;
+            const int32_t col = 2 + lane_index_list[i];
+            accumulate(0, j_pitch, col, -w, w * (g - p[col]));
+        }
+        return cost;
+    };
+
+    std::vector<double> JtJ(param_num * param_num), Jtr(param_num);
+    std::vector<double> JtJ_new(param_num * param_num), Jtr_new(param_num);
+    std::vector<double> A(param_num * param_num), delta(param_num), param_new(param_num);
+    int32_t residual_num = 0;
+    int32_t residual_num_new = 0;
+    double cost = evaluate(param, JtJ, Jtr, residual_num);
+    if (residual_num < 1 + (refine_height ? 1 : 0) + lane_num) {
+        printf("[RefineExtrinsicOnGround] Not enough constraints (%d)\n", residual_num);
+        return -1;
+    }
+
+    /*** Levenberg-Marquardt ***/
+    double lambda = 1e-3;
+    for (int32_t iter = 0; iter < max_iteration; iter++) {
+        /* (JtJ + lambda * diag(JtJ)) * delta = Jtr. Parameters without constraints (e.g. height for lanes only) get delta = 0 */
+        A = JtJ;
+        for (int32_t i = 0; i < param_num; i++) A[i * param_num + i] += lambda * JtJ[i * param_num + i] + 1e-12;
+        cv::Mat mat_A(param_num, param_num, CV_64FC1, A.data());
+        cv::Mat mat_b(param_num, 1, CV_64FC1, Jtr.data());
+        cv::Mat mat_delta(param_num, 1, CV_64FC1, delta.data());
+        if (!cv::solve(mat_A, mat_b, mat_delta, cv::DECOMP_CHOLESKY)) break;
+
+        double delta_max = 0;
+        for (int32_t i = 0; i < param_num; i++) {
+            param_new[i] = param[i] - delta[i];
+            delta_max = (std::max)(delta_max, std::abs(delta[i]));
+        }
+
+        const double cost_new = param_new[1] > 0 ? evaluate(param_new, JtJ_new, Jtr_new, residual_num_new) : std::numeric_limits<double>::max();
+        if (cost_new < cost) {
+            param.swap(param_new);
+            JtJ.swap(JtJ_new);
+            Jtr.swap(Jtr_new);
+            residual_num = residual_num_new;
+            cost = cost_new;
+            lambda *= 0.1;
+        } else {
+            lambda *= 10;
+        }
+        if (delta_max < 1e-9 || lambda > 1e6) break;
+    }
+
+    const Quaternion q_new = Quaternion::FromRotationVector(param[0], 0, 0) * q0;
+    SetPose(q_new, Vec3(T0[0], static_cast<Scalar>(-param[1]), T0[2]));
+    return static_cast<Scalar>(std::sqrt(cost / residual_num));
+}
+
+
+/*** Other methods ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::TransformObject(const Matx33& R, const Vec3& t, std::vector<Point3>& object_point_list)
+{
+    TransformObject(R, t, object_point_list.data(), static_cast<int32_t>(object_point_list.size()));
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::TransformObject(const Matx33& R, const Vec3& t, Point3* object_point_list, int32_t num)
+{
+    /* Copy parameters to local variables so that the compiler keeps them in registers */
+    const Scalar r0 = R(0, 0), r1 = R(0, 1), r2 = R(0, 2);
+    const Scalar r3 = R(1, 0), r4 = R(1, 1), r5 = R(1, 2);
+    const Scalar r6 = R(2, 0), r7 = R(2, 1), r8 = R(2, 2);
+    const Scalar t0 = t[0], t1 = t[1], t2 = t[2];
+
+    static constexpr int32_t kBlockSize = 4096;
+    const int32_t block_num = (num + kBlockSize - 1) / kBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for if (block_num > 1)
+#endif
+    for (int32_t block = 0; block < block_num; block++) {
+        const int32_t offset = block * kBlockSize;
+        const int32_t end = (std::min)(offset + kBlockSize, num);
+        for (int32_t i = offset; i < end; i++) {
+            Point3& object_point = object_point_list[i];
+            const Scalar x = object_point.x;
+            const Scalar y = object_point.y;
+            const Scalar z = object_point.z;
+            object_point.x = r0 * x + r1 * y + r2 * z + t0;
+            object_point.y = r3 * x + r4 * y + r5 * z + t1;
+            object_point.z = r6 * x + r7 * y + r8 * z + t2;
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::RotateObject(Scalar x_deg, Scalar y_deg, Scalar z_deg, std::vector<Point3>& object_point_list)
+{
+    TransformObject(MakeRotationMat(x_deg, y_deg, z_deg), Vec3(0, 0, 0), object_point_list);
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::MoveObject(Scalar x, Scalar y, Scalar z, std::vector<Point3>& object_point_list)
+{
+    TransformObject(Matx33::eye(), Vec3(x, y, z), object_point_list);
+}
+
+/*** Derived parameters ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UpdateDerivedState() const
+{
+    DerivedState& state = derived_state_;
+    ProjectionParameter& param = state.projection_param;
+
+    /***
+    * cv::projectPoints converts rvec into R in double. R is made in the same way (not from q_), so that the projection is bit-compatible with cv::projectPoints
+    * q_ is used for pose math (SetCameraAngle, RotateCameraAngle, SLERP, etc.) where rounding error doesn't matter
+    ***/
+    cv::Vec3d rvec_d(this->rx(), this->ry(), this->rz());
+    cv::Matx33d R_d;
+    cv::Rodrigues(rvec_d, R_d);
+    for (int32_t i = 0; i < 9; i++) param.R[i] = R_d.val[i];
+    param.t[0] = this->tx();
+    param.t[1] = this->ty();
+    param.t[2] = this->tz();
+    param.fx = this->fx();
+    param.fy = this->fy();
+    param.cx = this->cx();
+    param.cy = this->cy();
+    /* The order of dist_coeff is the same as OpenCV (k1, k2, p1, p2, k3) */
+    param.k1 = dist_coeff_[0];
+    param.k2 = dist_coeff_[1];
+    param.p1 = dist_coeff_[2];
+    param.p2 = dist_coeff_[3];
+    param.k3 = dist_coeff_[4];
+    param.has_distortion = (param.k1 != 0 || param.k2 != 0 || param.p1 != 0 || param.p2 != 0 || param.k3 != 0);
+    param.xi = xi_;
+    param.z_limit = xi_ > 0 ? -(std::min)(param.xi, 1.0 / param.xi) : 0;
+
+    state.R = Matx33(R_d);
+    state.R_inv = state.R.t();    /* R is orthogonal */
+    state.R_inv_t = state.R_inv * tvec_;
+
+    /* Rolling shutter: R(time) = R_delta(angular_velocity * time) * R, T(time) = T + linear_velocity * time (T: camera position in world) */
+    param.row_num = 0;
+    state.row_pose_list.clear();    /* capacity is kept, so no allocation every frame */
+    if (line_readout_time_ > 0) {
+        const cv::Vec3d t_d(param.t[0], param.t[1], param.t[2]);
+        const cv::Vec3d T = -(R_d.t() * t_d);   /* t = -RT */
+        const cv::Vec3d linear_velocity(linear_velocity_[0], linear_velocity_[1], linear_velocity_[2]);
+        const cv::Vec3d angular_velocity(angular_velocity_[0], angular_velocity_[1], angular_velocity_[2]);
+        state.row_pose_list.resize(height_);
+        for (int32_t row = 0; row < height_; row++) {
+            const double time = row * static_cast<double>(line_readout_time_);
+            const cv::Vec3d rvec_delta = angular_velocity * time;
+            const cv::Matx33d R_delta = Quaternion::FromRotationVector(rvec_delta[0], rvec_delta[1], rvec_delta[2]).ToRotationMatrix();
+            const cv::Matx33d R_row = R_delta * R_d;
+            const cv::Vec3d t_row = -(R_row * (T + linear_velocity * time));
+
+            RowPose& pose = state.row_pose_list[row];
+            for (int32_t i = 0; i < 9; i++) pose.R[i] = R_row.val[i];
+            for (int32_t i = 0; i < 3; i++) pose.t[i] = t_row[i];
+            pose.R_inv = Matx33(R_row.t());
+            pose.tvec = Vec3(static_cast<Scalar>(t_row[0]), static_cast<Scalar>(t_row[1]), static_cast<Scalar>(t_row[2]));
+            pose.R_inv_t = pose.R_inv * pose.tvec;
+        }
+        param.row_num = height_;
+    }
+
+    UpdateFrustumBound(state);
+}
+
+
+/*** Ray table ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UpdateRayTable()
+{
+    std::vector<Point2> image_point_list;
+    image_point_list.reserve(width_ * height_);
+    for (int32_t y = 0; y < height_; y++) {
+        for (int32_t x = 0; x < width_; x++) {
+            image_point_list.push_back(Point2(Scalar(x), Scalar(y)));
+        }
+    }
+    std::vector<Point2> ray_point_list;
+    ConvertImage2Ray(image_point_list, ray_point_list);
+
+    /* Release first, because the current table may be read-only external memory (SetRayTable) */
+    ray_table_.release();
+    ray_table_storage_.reset();
+    ray_table_.create(height_, width_, CV_MAKETYPE(kMatDepth, 2));
+    cv::Vec<Scalar, 2>* ray_list = ray_table_.ptr<cv::Vec<Scalar, 2>>();
+    for (int32_t i = 0; i < ray_point_list.size(); i++) {
+        ray_list[i] = cv::Vec<Scalar, 2>(ray_point_list[i].x, ray_point_list[i].y);
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::ConvertImage2Ray(const std::vector<Point2>& image_point_list, std::vector<Point2>& ray_list) const
+{
+    const ProjectionParameter& param = GetDerivedState().projection_param;
+    ray_list.resize(image_point_list.size());
+    if (image_point_list.empty()) return;
+    UndistortPoints(image_point_list.data(), static_cast<int32_t>(image_point_list.size()), ray_list.data());
+
+    if (Projection::kIsUnified) {
+        /* Normalized image coordinate on the unified model -> ray */
+        const Scalar nan = std::numeric_limits<Scalar>::quiet_NaN();
+        for (auto& ray : ray_list) {
+            double x, y;
+            const bool is_valid = Projection::Lift(param.xi, ray.x, ray.y, x, y);
+            ray.x = is_valid ? static_cast<Scalar>(x) : nan;
+            ray.y = is_valid ? static_cast<Scalar>(y) : nan;
+        }
+    }
+}
+
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UndistortPoints(const Point2* image_point_list, int32_t num, Point2* ray_list) const
+{
+    const ProjectionParameter& param = GetDerivedState().projection_param;
+    UndistortBatch(param, undistortion_max_iteration_, undistortion_epsilon_, image_point_list, num, ray_list);
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UndistortBatch(const ProjectionParameter& param, int32_t max_iteration, double epsilon, const Point2* image_point_list, int32_t num, Point2* ray_list)
+{
+    if (!param.has_distortion) max_iteration = 0;
+
+    /* Split into blocks so that each thread works on a contiguous range */
+    static constexpr int32_t kBlockSize = 4096;
+    const int32_t block_num = (num + kBlockSize - 1) / kBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t block = 0; block < block_num; block++) {
+        const int32_t offset = block * kBlockSize;
+        const int32_t size = (std::min)(kBlockSize, num - offset);
+        if (epsilon > 0) {
+            UndistortKernel<true>(param, max_iteration, epsilon, image_point_list, ray_list, offset, size);
+        } else {
+            UndistortKernel<false>(param, max_iteration, epsilon, image_point_list, ray_list, offset, size);
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+template <bool kUseEpsilon>
+void CameraModelT<Scalar, Projection>::UndistortKernel(const ProjectionParameter& param, int32_t max_iteration, double epsilon, const Point2* image_point_list, Point2* ray_list, int32_t offset, int32_t size)
+{
+    /***
+    * Inverse of the distortion in ProjectCameraPoint by fixed-point iteration (the same as cv::undistortPoints)
+    *   x0 = x * cdist + delta_x  ->  x = (x0 - delta_x) / cdist
+    ***/
+    const ProjectionParameter param_local = param;  /* not aliased with the output */
+    const double fx_inv = 1.0 / param_local.fx, fy_inv = 1.0 / param_local.fy;
+    const double cx = param_local.cx, cy = param_local.cy;
+    const double k1 = param_local.k1, k2 = param_local.k2, p1 = param_local.p1, p2 = param_local.p2, k3 = param_local.k3;
+
+    for (int32_t i = offset; i < offset + size; i++) {
+        const double x0 = (image_point_list[i].x - cx) * fx_inv;
+        const double y0 = (image_point_list[i].y - cy) * fy_inv;
+        double x = x0;
+        double y = y0;
+        for (int32_t iteration = 0; iteration < max_iteration; iteration++) {
+            const double r2 = x * x + y * y;
+            const double icdist = 1 / (1 + ((k3 * r2 + k2) * r2 + k1) * r2);
+            if (icdist < 0) {
+                /* diverged */
+                x = x0;
+                y = y0;
+                break;
+            }
+            const double delta_x = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+            const double delta_y = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+            const double x_new = (x0 - delta_x) * icdist;
+            const double y_new = (y0 - delta_y) * icdist;
+            if (kUseEpsilon) {
+                const double update = std::abs(x_new - x) + std::abs(y_new - y);
+                x = x_new;
+                y = y_new;
+                if (update < epsilon) break;
+            } else {
+                x = x_new;
+                y = y_new;
+            }
+        }
+        ray_list[i].x = static_cast<Scalar>(x);
+        ray_list[i].y = static_cast<Scalar>(y);
+    }
+}
+
+
+/*** Undistortion map ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::CreateUndistortMap(const cv::Size& undist_image_size, const Matx33& K_undist, cv::Mat& mapx, cv::Mat& mapy)
+{
+    /* Pixel on the undistorted image -> ray (Mc without rotation) -> pixel on this camera */
+    ProjectionParameter param = GetDerivedState().projection_param;
+    for (int32_t i = 0; i < 9; i++) param.R[i] = (i % 4 == 0) ? 1 : 0;
+    param.t[0] = param.t[1] = param.t[2] = 0;
+    const double fx_undist_inv = 1.0 / K_undist(0, 0);
+    const double fy_undist_inv = 1.0 / K_undist(1, 1);
+    const double cx_undist = K_undist(0, 2);
+    const double cy_undist = K_undist(1, 2);
+
+    mapx.create(undist_image_size, CV_32FC1);
+    mapy.create(undist_image_size, CV_32FC1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < undist_image_size.height; y++) {
+        float* mapx_row = mapx.ptr<float>(y);
+        float* mapy_row = mapy.ptr<float>(y);
+        const double Yc = (y - cy_undist) * fy_undist_inv;
+        for (int32_t x = 0; x < undist_image_size.width; x++) {
+            const double Xc = (x - cx_undist) * fx_undist_inv;
+            double u, v;
+            const bool is_front = param.has_distortion ? ProjectCameraPoint<true>(param, Xc, Yc, 1.0, u, v) : ProjectCameraPoint<false>(param, Xc, Yc, 1.0, u, v);
+            mapx_row[x] = is_front ? static_cast<float>(u) : -1.0f;
+            mapy_row[x] = is_front ? static_cast<float>(v) : -1.0f;
+        }
+    }
+}
+
+
+/*** Ground plane map ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UpdateGroundPlaneMap()
+{
+    typedef cv::Vec<Scalar, 3> MapElement;
+    const int32_t subsample = ground_plane_map_subsample_;
+    const int32_t grid_width = (width_ - 1) / subsample + 2;
+    const int32_t grid_height = (height_ - 1) / subsample + 2;
+
+    std::vector<Point2> grid_point_list;
+    grid_point_list.reserve(grid_width * grid_height);
+    for (int32_t y = 0; y < grid_height; y++) {
+        for (int32_t x = 0; x < grid_width; x++) {
+            grid_point_list.push_back(Point2(static_cast<Scalar>(x * subsample), static_cast<Scalar>(y * subsample)));
+        }
+    }
+    std::vector<Point3> object_point_list;
+    ConvertImage2GroundPlaneDirect(grid_point_list, object_point_list);
+
+    /* Release first, because the current map may be read-only external memory (SetGroundPlaneMap) */
+    ground_plane_map_.release();
+    ground_plane_map_storage_.reset();
+    ground_plane_map_.create(grid_height, grid_width, CV_MAKETYPE(kMatDepth, 3));
+    for (int32_t y = 0; y < grid_height; y++) {
+        for (int32_t x = 0; x < grid_width; x++) {
+            /* Invalid: above the horizon or behind the camera */
+            const auto& object_point = object_point_list[y * grid_width + x];
+            const bool is_valid = object_point.y != 999 && object_point.z != 999;
+            ground_plane_map_.at<MapElement>(y, x) = is_valid ? MapElement(object_point.x, object_point.z, 1) : MapElement(0, 0, 0);
+        }
+    }
+}
+
+
+/*** Batch projection kernel ***/
+template <typename Scalar, typename Projection>
+template <int32_t kInStride, int32_t kOutStride>
+void CameraModelT<Scalar, Projection>::ProjectBatch(const ProjectionParameter& param, const RowPose* row_pose_list, const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, Scalar* u_list, Scalar* v_list, int32_t num)
+{
+    /* Split into blocks so that each thread works on a contiguous range */
+    static constexpr int32_t kBlockSize = 4096;
+    const int32_t block_num = (num + kBlockSize - 1) / kBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t block = 0; block < block_num; block++) {
+        const int32_t offset = block * kBlockSize;
+        const int32_t size = (std::min)(kBlockSize, num - offset);
+        if (param.has_distortion) {
+            ProjectKernel<true, kInStride, kOutStride>(param, row_pose_list, x_list, y_list, z_list, u_list, v_list, offset, size);
+        } else {
+            ProjectKernel<false, kInStride, kOutStride>(param, row_pose_list, x_list, y_list, z_list, u_list, v_list, offset, size);
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+template <bool kHasDistortion, int32_t kInStride, int32_t kOutStride, bool kOutputDepth>
+inline void CameraModelT<Scalar, Projection>::ProjectKernel(const ProjectionParameter& param, const RowPose* row_pose_list, const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, Scalar* u_list, Scalar* v_list, int32_t offset, int32_t size, Scalar* depth_list)
+{
+    if (row_pose_list) {
+        /***
+        * Rolling shutter: the pose depends on the row where the point is read out, which depends on the pose
+        *   1. Project with the pose of the center row without distortion (just to estimate the row roughly)
+        *   2. Project with the pose of the estimated row, and update the row (kRefineNum times)
+        * The row moves by less than one row per refinement unless the camera moves extremely fast, so it converges quickly
+        ***/
+        static constexpr int32_t kRefineNum = 2;
+        const ProjectionParameter param_local = param;
+        const double row_max = param_local.row_num - 1;
+        for (int32_t i = offset; i < offset + size; i++) {
+            const double Xw = x_list[i * kInStride];
+            const double Yw = y_list[i * kInStride];
+            const double Zw = z_list[i * kInStride];
+            int32_t row = param_local.row_num / 2;
+            double Xc = 0, Yc = 0, Zc = 0, u = 0, v = 0;
+            bool is_front = false;
+            for (int32_t iteration = 0; iteration <= kRefineNum; iteration++) {
+                const RowPose& pose = row_pose_list[row];
+                Xc = pose.R[0] * Xw + pose.R[1] * Yw + pose.R[2] * Zw + pose.t[0];
+                Yc = pose.R[3] * Xw + pose.R[4] * Yw + pose.R[5] * Zw + pose.t[1];
+                Zc = pose.R[6] * Xw + pose.R[7] * Yw + pose.R[8] * Zw + pose.t[2];
+                is_front = (iteration == 0) ? ProjectCameraPoint<false>(param_local, Xc, Yc, Zc, u, v) : ProjectCameraPoint<kHasDistortion>(param_local, Xc, Yc, Zc, u, v);
+                const double v_clamped = v > 0 ? (v < row_max ? v : row_max) : 0;     /* also for NaN */
+                row = static_cast<int32_t>(v_clamped + 0.5);
+            }
+            u_list[i * kOutStride] = is_front ? static_cast<Scalar>(u) : Scalar(-1);
+            v_list[i * kOutStride] = is_front ? static_cast<Scalar>(v) : Scalar(-1);
+            if (kOutputDepth) depth_list[i] = static_cast<Scalar>(Zc);
+        }
+        return;
+    }
+
+    /* Copy parameters to local variables so that the compiler keeps them in registers */
+    const double r0 = param.R[0], r1 = param.R[1], r2 = param.R[2];
+    const double r3 = param.R[3], r4 = param.R[4], r5 = param.R[5];
+    const double r6 = param.R[6], r7 = param.R[7], r8 = param.R[8];
+    const double t0 = param.t[0], t1 = param.t[1], t2 = param.t[2];
+    const ProjectionParameter param_local = param;  /* not aliased with the output */
+
+    /* No branch in the loop so that the compiler can vectorize it */
+    for (int32_t i = offset; i < offset + size; i++) {
+        const double Xw = x_list[i * kInStride];
+        const double Yw = y_list[i * kInStride];
+        const double Zw = z_list[i * kInStride];
+
+        /* Mc = [R t] * [Mw, 1] */
+        const double Xc = r0 * Xw + r1 * Yw + r2 * Zw + t0;
+        const double Yc = r3 * Xw + r4 * Yw + r5 * Zw + t1;
+        const double Zc = r6 * Xw + r7 * Yw + r8 * Zw + t2;
+
+        double u, v;
+        const bool is_front = ProjectCameraPoint<kHasDistortion>(param_local, Xc, Yc, Zc, u, v);
+
+        /* Do not project points behind the camera */
+        u_list[i * kOutStride] = is_front ? static_cast<Scalar>(u) : Scalar(-1);
+        v_list[i * kOutStride] = is_front ? static_cast<Scalar>(v) : Scalar(-1);
+        if (kOutputDepth) depth_list[i] = static_cast<Scalar>(Zc);
+    }
+}
+
+template <typename Scalar, typename Projection>
+template <bool kHasDistortion>
+inline bool CameraModelT<Scalar, Projection>::ProjectCameraPoint(const ProjectionParameter& param, double Xc, double Yc, double Zc, double& u, double& v)
+{
+    /*** Mc -> Image ***/
+    double x, y;
+    const bool is_front = Projection::Normalize(param.xi, param.z_limit, Xc, Yc, Zc, x, y);
+
+    if (kHasDistortion) {
+        /*** Distort ***/
+        const double rr2 = x * x + y * y;
+        const double rr4 = rr2 * rr2;
+        const double rr6 = rr4 * rr2;
+        const double a1 = 2 * x * y;
+        const double a2 = rr2 + 2 * x * x;
+        const double a3 = rr2 + 2 * y * y;
+        const double cdist = 1 + param.k1 * rr2 + param.k2 * rr4 + param.k3 * rr6;
+        const double xd = x * cdist + param.p1 * a1 + param.p2 * a2;
+        const double yd = y * cdist + param.p1 * a3 + param.p2 * a1;
+        x = xd;
+        y = yd;
+    }
+
+    u = x * param.fx + param.cx;
+    v = y * param.fy + param.cy;
+    return is_front;
+}
+
+template <typename Scalar, typename Projection>
+template <bool kHasDistortion>
+void CameraModelT<Scalar, Projection>::JacobianKernel(const ProjectionParameter& param, const Point3* object_point_list, Point2* image_point_list, Matx26* jacobian_pose_list, Matx23* jacobian_point_list, Matx29* jacobian_intrinsic_list, int32_t offset, int32_t size)
+{
+    /***
+    * (u, v) = diag(fx, fy) * Distort(Normalize(Mc)) + (cx, cy),  Mc = P + t,  P = R * Mw
+    *   d(u, v)/dMc = diag(fx, fy) * d(xd, yd)/d(x, y) * d(x, y)/dMc   (2 x 3)
+    *   dMc/dw = -[P]x,  dMc/dt = I,  dMc/dMw = R
+    ***/
+    const ProjectionParameter param_local = param;
+    const double* R = param_local.R;
+    for (int32_t i = offset; i < offset + size; i++) {
+        const Point3& object_point = object_point_list[i];
+        const double Xw = object_point.x;
+        const double Yw = object_point.y;
+        const double Zw = object_point.z;
+        const double Px = R[0] * Xw + R[1] * Yw + R[2] * Zw;
+        const double Py = R[3] * Xw + R[4] * Yw + R[5] * Zw;
+        const double Pz = R[6] * Xw + R[7] * Yw + R[8] * Zw;
+        const double Xc = Px + param_local.t[0];
+        const double Yc = Py + param_local.t[1];
+        const double Zc = Pz + param_local.t[2];
+
+        double x, y;
+        const bool is_front = Projection::Normalize(param_local.xi, param_local.z_limit, Xc, Yc, Zc, x, y);
+        if (!is_front) {
+            image_point_list[i] = Point2(-1, -1);
+            jacobian_pose_list[i] = Matx26::zeros();
+            jacobian_point_list[i] = Matx23::zeros();
+            if (jacobian_intrinsic_list) jacobian_intrinsic_list[i] = Matx29::zeros();
+            continue;
+        }
+        double jn[6];
+        Projection::NormalizeJacobian(param_local.xi, Xc, Yc, Zc, jn);
+
+        /* Terms of distortion are also needed for the intrinsic Jacobian without distortion (derivative at k = p = 0) */
+        const double rr2 = x * x + y * y;
+        const double rr4 = rr2 * rr2;
+        const double rr6 = rr4 * rr2;
+        const double a1 = 2 * x * y;
+        const double a2 = rr2 + 2 * x * x;
+        const double a3 = rr2 + 2 * y * y;
+        double xd = x, yd = y;
+        double jd[4] = { 1, 0, 0, 1 };    /* d(xd, yd) / d(x, y) */
+        if (kHasDistortion) {
+            const double cdist = 1 + param_local.k1 * rr2 + param_local.k2 * rr4 + param_local.k3 * rr6;
+            const double dcdist = param_local.k1 + 2 * param_local.k2 * rr2 + 3 * param_local.k3 * rr4;   /* d(cdist) / d(rr2) */
+            xd = x * cdist + param_local.p1 * a1 + param_local.p2 * a2;
+            yd = y * cdist + param_local.p1 * a3 + param_local.p2 * a1;
+            jd[0] = cdist + 2 * x * x * dcdist + 2 * param_local.p1 * y + 6 * param_local.p2 * x;
+            jd[1] = 2 * x * y * dcdist + 2 * param_local.p1 * x + 2 * param_local.p2 * y;
+            jd[2] = jd[1];
+            jd[3] = cdist + 2 * y * y * dcdist + 6 * param_local.p1 * y + 2 * param_local.p2 * x;
+        }
+        image_point_list[i] = Point2(static_cast<Scalar>(xd * param_local.fx + param_local.cx), static_cast<Scalar>(yd * param_local.fy + param_local.cy));
+
+        /* d(u, v) / dMc */
+        double jm[6];
+        for (int32_t c = 0; c < 3; c++) {
+            jm[c] = param_local.fx * (jd[0] * jn[c] + jd[1] * jn[3 + c]);
+            jm[3 + c] = param_local.fy * (jd[2] * jn[c] + jd[3] * jn[3 + c]);
+        }
+
+        Matx26& jacobian_pose = jacobian_pose_list[i];
+        Matx23& jacobian_point = jacobian_point_list[i];
+        for (int32_t r = 0; r < 2; r++) {
+            const double* j = jm + r * 3;
+            jacobian_pose(r, 0) = static_cast<Scalar>(-j[1] * Pz + j[2] * Py);
+            jacobian_pose(r, 1) = static_cast<Scalar>(j[0] * Pz - j[2] * Px);
+            jacobian_pose(r, 2) = static_cast<Scalar>(-j[0] * Py + j[1] * Px);
+            jacobian_pose(r, 3) = static_cast<Scalar>(j[0]);
+            jacobian_pose(r, 4) = static_cast<Scalar>(j[1]);
+            jacobian_pose(r, 5) = static_cast<Scalar>(j[2]);
+            for (int32_t c = 0; c < 3; c++) {
+                jacobian_point(r, c) = static_cast<Scalar>(j[0] * R[c] + j[1] * R[3 + c] + j[2] * R[6 + c]);
+            }
+        }
+
+        if (jacobian_intrinsic_list) {
+            /* fx, fy, cx, cy, k1, k2, p1, p2, k3 */
+            const double fx = param_local.fx;
+            const double fy = param_local.fy;
+            const double jacobian_intrinsic[18] = {
+                xd, 0, 1, 0, fx * x * rr2, fx * x * rr4, fx * a1, fx * a2, fx * x * rr6,
+                0, yd, 0, 1, fy * y * rr2, fy * y * rr4, fy * a3, fy * a1, fy * y * rr6 };
+            for (int32_t k = 0; k < 18; k++) jacobian_intrinsic_list[i].val[k] = static_cast<Scalar>(jacobian_intrinsic[k]);
+        }
+    }
+}
+
+
+/*** Frustum culling ***/
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::CullPoints(const std::vector<Point3>& object_point_list, std::vector<int32_t>& index_list, Scalar margin_px) const
+{
+    const FrustumBound bound = GetFrustumBound(margin_px);
+    const ProjectionParameter& param = GetDerivedState().projection_param;
+    const int32_t num = static_cast<int32_t>(object_point_list.size());
+
+    std::vector<uint8_t> is_in_list(num);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const Point3& p = object_point_list[i];
+        is_in_list[i] = IsInFrustum(param, bound, p.x, p.y, p.z);
+    }
+
+    index_list.clear();
+    for (int32_t i = 0; i < num; i++) {
+        if (is_in_list[i]) index_list.push_back(i);
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::CullPoints(const std::vector<Point3>& object_point_list, const PointBucket& bucket, std::vector<int32_t>& index_list, Scalar margin_px) const
+{
+    const FrustumBound bound = GetFrustumBound(margin_px);
+    const ProjectionParameter& param = GetDerivedState().projection_param;
+
+    /***
+    * Frustum planes in camera coordinate. A point is inside when plane . Mc <= 0 for all planes
+    *   x >= x_min, x <= x_max, y >= y_min, y <= y_max (x = Xc / Zc), Zc >= 0
+    * plane . Mc = plane . (R * Mw + t) = (R^T * plane) . Mw + plane . t
+    ***/
+    const double plane_list[5][3] = {
+        { -1, 0, bound.x_min }, { 1, 0, -bound.x_max },
+        { 0, -1, bound.y_min }, { 0, 1, -bound.y_max },
+        { 0, 0, -1 } };
+    double plane_world_list[5][4];
+    for (int32_t k = 0; k < 5; k++) {
+        const double* c = plane_list[k];
+        for (int32_t j = 0; j < 3; j++) {
+            plane_world_list[k][j] = param.R[j] * c[0] + param.R[3 + j] * c[1] + param.R[6 + j] * c[2];
+        }
+        plane_world_list[k][3] = c[0] * param.t[0] + c[1] * param.t[1] + c[2] * param.t[2];
+    }
+
+    /* Classify buckets by their AABB: fully outside any plane = skip, inside all planes = accept all points, otherwise test each point */
+    index_list.clear();
+    std::vector<int32_t> candidate_list;
+    for (const auto& b : bucket.bucket_list) {
+        bool is_outside = false;
+        bool is_inside = !Projection::kIsUnified;   /* the frustum of the unified model is not a pyramid */
+        if (!Projection::kIsUnified) {
+            for (int32_t k = 0; k < 5; k++) {
+                const double* plane = plane_world_list[k];
+                double center_dist = plane[3];
+                double radius = 0;
+                for (int32_t j = 0; j < 3; j++) {
+                    center_dist += plane[j] * (static_cast<double>(b.min[j]) + b.max[j]) * 0.5;
+                    radius += std::abs(plane[j]) * (static_cast<double>(b.max[j]) - b.min[j]) * 0.5;
+                }
+                if (center_dist - radius > 0) {
+                    is_outside = true;
+                    break;
+                }
+                if (center_dist + radius >= 0) is_inside = false;
+            }
+        }
+        if (is_outside) continue;
+        std::vector<int32_t>& dst = is_inside ? index_list : candidate_list;
+        dst.insert(dst.end(), bucket.index_list.begin() + b.begin, bucket.index_list.begin() + b.end);
+    }
+
+    /* Test each point in buckets on the frustum boundary */
+    const int32_t candidate_num = static_cast<int32_t>(candidate_list.size());
+    std::vector<uint8_t> is_in_list(candidate_num);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < candidate_num; i++) {
+        const Point3& p = object_point_list[candidate_list[i]];
+        is_in_list[i] = IsInFrustum(param, bound, p.x, p.y, p.z);
+    }
+    for (int32_t i = 0; i < candidate_num; i++) {
+        if (is_in_list[i]) index_list.push_back(candidate_list[i]);
+    }
+}
+
+template <typename Scalar, typename Projection>
+typename CameraModelT<Scalar, Projection>::FrustumBound CameraModelT<Scalar, Projection>::GetFrustumBound(Scalar margin_px) const
+{
+    const DerivedState& state = GetDerivedState();
+    FrustumBound bound = state.frustum_bound;
+    const double margin_x = margin_px / state.projection_param.fx;
+    const double margin_y = margin_px / state.projection_param.fy;
+    bound.x_min -= margin_x;
+    bound.x_max += margin_x;
+    bound.y_min -= margin_y;
+    bound.y_max += margin_y;
+    return bound;
+}
+
+template <typename Scalar, typename Projection>
+void CameraModelT<Scalar, Projection>::UpdateFrustumBound(DerivedState& state) const
+{
+    /* Called from UpdateDerivedState. Re-calculated only when intrinsic parameters are changed */
+    IntrinsicKey key = MakeIntrinsicKey();
+    if (state.has_frustum_bound && state.frustum_bound_key == key) return;
+
+    /***
+    * Undistort points on the border of the image, and use their bounding box
+    * Lens distortion changes the shape of the border, so the box is larger than the image for barrel distortion
+    ***/
+    static constexpr int32_t kStepPx = 8;
+    const Scalar right = static_cast<Scalar>(width_);
+    const Scalar bottom = static_cast<Scalar>(height_);
+    std::vector<Point2> border_point_list;
+    for (Scalar x = 0; x < right; x += kStepPx) {
+        border_point_list.push_back(Point2(x, 0));
+        border_point_list.push_back(Point2(x, bottom));
+    }
+    for (Scalar y = 0; y < bottom; y += kStepPx) {
+        border_point_list.push_back(Point2(0, y));
+        border_point_list.push_back(Point2(right, y));
+    }
+    border_point_list.push_back(Point2(right, bottom));
+    UndistortBatch(state.projection_param, undistortion_max_iteration_, undistortion_epsilon_, border_point_list.data(), static_cast<int32_t>(border_point_list.size()), border_point_list.data());
+
+    FrustumBound& bound = state.frustum_bound;
+    bound.x_min = bound.y_min = std::numeric_limits<double>::max();
+    bound.x_max = bound.y_max = std::numeric_limits<double>::lowest();
+    for (const auto& p : border_point_list) {
+        bound.x_min = (std::min)(bound.x_min, static_cast<double>(p.x));
+        bound.x_max = (std::max)(bound.x_max, static_cast<double>(p.x));
+        bound.y_min = (std::min)(bound.y_min, static_cast<double>(p.y));
+        bound.y_max = (std::max)(bound.y_max, static_cast<double>(p.y));
+    }
+    state.frustum_bound_key = key;
+    state.has_frustum_bound = true;
+}
+
+template <typename Scalar>
+void PointBucketT<Scalar>::Build(const std::vector<cv::Point3_<Scalar>>& object_point_list, Scalar bucket_size)
+{
+    bucket_list.clear();
+    index_list.clear();
+    if (!(bucket_size > 0)) {
+        printf("[PointBucket::Build] invalid bucket size: %f\n", static_cast<double>(bucket_size));
+        return;
+    }
+
+    /* Bounding box of all the points */
+    const int32_t num = static_cast<int32_t>(object_point_list.size());
+    double bb_min[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    for (const auto& p : object_point_list) {
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        bb_min[0] = (std::min)(bb_min[0], static_cast<double>(p.x));
+        bb_min[1] = (std::min)(bb_min[1], static_cast<double>(p.y));
+        bb_min[2] = (std::min)(bb_min[2], static_cast<double>(p.z));
+    }
+
+    /* Sort points by cell. The number of cells per axis is clamped (points in the last cell just make a larger bucket) */
+    static constexpr int64_t kMaxCellNum = 1 << 20;
+    std::vector<std::pair<int64_t, int32_t>> key_list;
+    key_list.reserve(num);
+    for (int32_t i = 0; i < num; i++) {
+        const auto& p = object_point_list[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        int64_t cell[3];
+        const double xyz[3] = { static_cast<double>(p.x), static_cast<double>(p.y), static_cast<double>(p.z) };
+        for (int32_t j = 0; j < 3; j++) {
+            cell[j] = (std::min)(static_cast<int64_t>((xyz[j] - bb_min[j]) / bucket_size), kMaxCellNum - 1);
+        }
+        key_list.push_back(std::make_pair((cell[0] * kMaxCellNum + cell[1]) * kMaxCellNum + cell[2], i));
+    }
+    std::sort(key_list.begin(), key_list.end());
+
+    /* Create a bucket for each run of the same cell */
+    index_list.resize(key_list.size());
+    for (int32_t i = 0; i < static_cast<int32_t>(key_list.size()); i++) {
+        const int32_t index = key_list[i].second;
+        const auto& p = object_point_list[index];
+        index_list[i] = index;
+        if (i == 0 || key_list[i].first != key_list[i - 1].first) {
+            Bucket bucket;
+            bucket.min = bucket.max = cv::Vec<Scalar, 3>(p.x, p.y, p.z);
+            bucket.begin = i;
+            bucket.end = i;
+            bucket_list.push_back(bucket);
+        }
+        Bucket& bucket = bucket_list.back();
+        bucket.min = cv::Vec<Scalar, 3>((std::min)(bucket.min[0], p.x), (std::min)(bucket.min[1], p.y), (std::min)(bucket.min[2], p.z));
+        bucket.max = cv::Vec<Scalar, 3>((std::max)(bucket.max[0], p.x), (std::max)(bucket.max[1], p.y), (std::max)(bucket.max[2], p.z));
+        bucket.end = i + 1;
+    }
+}
+
+
+/*** Explicit instantiation ***/
+/* Must be after all the definitions */
+template class CameraModelT<float, PinholeProjection>;
+template class CameraModelT<double, PinholeProjection>;
+template class CameraModelT<float, UnifiedProjection>;
+template class CameraModelT<double, UnifiedProjection>;
+template struct PointBucketT<float>;
+template struct PointBucketT<double>;
@@ -24,11 +24,14 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
-#ifdef _OPENMP
-#include <omp.h>
-#endif
+
+#include "quaternion.h"
 
 #ifndef M_PI
 #define M_PI 3.141592653f
@@ -36,13 +39,147 @@ limitations under the License.
 
 static inline float Deg2Rad(float deg) { return static_cast<float>(deg * M_PI / 180.0); }
 static inline float Rad2Deg(float rad) { return static_cast<float>(rad * 180.0 / M_PI); }
+static inline double Deg2Rad(double deg) { return deg * M_PI / 180.0; }
+static inline double Rad2Deg(double rad) { return rad * 180.0 / M_PI; }
 static inline float FocalLength(int32_t image_size, float fov)
 {
     /* (w/2) / f = tan(fov/2) */
     return (image_size / 2) / std::tan(Deg2Rad(fov / 2));
 }
 
-class CameraModel {
+/*** Projection model policy ***/
+/***
+* Convert a point in camera coordinate into normalized image coordinate (before lens distortion), and its inverse (Lift)
+*   Lens distortion (k1, k2, p1, p2, k3) is applied on the normalized image coordinate for all models
+*   Calculation is done in double, and all functions are inlined into the conversion loops (no virtual call)
+***/
+struct PinholeProjection {
+    static constexpr bool kIsUnified = false;
+
+    /* (x, y) = (Xc / Zc, Yc / Zc). return false if the point is behind the camera */
+    static inline bool Normalize(double xi, double z_limit, double Xc, double Yc, double Zc, double& x, double& y)
+    {
+        const double z_inv = Zc != 0 ? 1. / Zc : 1;
+        x = Xc * z_inv;
+        y = Yc * z_inv;
+        return Zc > 0;
+    }
+
+    /* d(x, y) / d(Xc, Yc, Zc), 2 x 3 (row major) */
+    static inline void NormalizeJacobian(double xi, double Xc, double Yc, double Zc, double* J)
+    {
+        const double z_inv = Zc != 0 ? 1. / Zc : 1;
+        J[0] = z_inv;
+        J[1] = 0;
+        J[2] = -Xc * z_inv * z_inv;
+        J[3] = 0;
+        J[4] = z_inv;
+        J[5] = -Yc * z_inv * z_inv;
+    }
+
+    /* (x, y) = ray (Xc / Zc, Yc / Zc) from undistorted normalized image coordinate (mx, my). return false if the ray doesn't exist */
+    static inline bool Lift(double xi, double mx, double my, double& x, double& y)
+    {
+        x = mx;
+        y = my;
+        return true;
+    }
+};
+
+struct UnifiedProjection {
+    /***
+    * Unified projection model (for fisheye / omnidirectional camera)
+    *   Mc is projected onto a unit sphere (Xs, Ys, Zs) = Mc / |Mc|, then projected from (0, 0, -xi)
+    *   (x, y) = (Xs / (Zs + xi), Ys / (Zs + xi))
+    *   xi = 0: pinhole
+    * reference: C. Mei and P. Rives, Single View Point Omnidirectional Camera Calibration from Planar Grids, 2007
+    * reference: https://github.com/alexvbogdan/DeepCalib/blob/master/undistortion/undistSphIm.m
+    ***/
+    static constexpr bool kIsUnified = true;
+
+    /* z_limit = -min(xi, 1/xi): points whose Zs is less than this are not visible */
+    static inline bool Normalize(double xi, double z_limit, double Xc, double Yc, double Zc, double& x, double& y)
+    {
+        const double norm = std::sqrt(Xc * Xc + Yc * Yc + Zc * Zc);
+        const double den = Zc + xi * norm;
+        const double den_inv = den != 0 ? 1. / den : 1;
+        x = Xc * den_inv;
+        y = Yc * den_inv;
+        return norm > 0 && Zc > z_limit * norm && den > 0;
+    }
+
+    /* d(x, y) / d(Xc, Yc, Zc), 2 x 3 (row major). d(den) / d(Mc) = xi * Mc / norm + (0, 0, 1) */
+    static inline void NormalizeJacobian(double xi, double Xc, double Yc, double Zc, double* J)
+    {
+        const double norm = std::sqrt(Xc * Xc + Yc * Yc + Zc * Zc);
+        const double norm_inv = norm > 0 ? 1. / norm : 0;
+        const double den = Zc + xi * norm;
+        const double den_inv = den != 0 ? 1. / den : 1;
+        const double x = Xc * den_inv;
+        const double y = Yc * den_inv;
+        const double dden_x = xi * Xc * norm_inv * den_inv;
+        const double dden_y = xi * Yc * norm_inv * den_inv;
+        const double dden_z = (1 + xi * Zc * norm_inv) * den_inv;
+        J[0] = den_inv - x * dden_x;
+        J[1] = -x * dden_y;
+        J[2] = -x * dden_z;
+        J[3] = -y * dden_x;
+        J[4] = den_inv - y * dden_y;
+        J[5] = -y * dden_z;
+    }
+
+    static inline bool Lift(double xi, double mx, double my, double& x, double& y)
+    {
+        const double r2 = mx * mx + my * my;
+        const double disc = 1 + (1 - xi * xi) * r2;
+        if (disc < 0) return false;
+        const double factor = (xi + std::sqrt(disc)) / (r2 + 1);
+        const double Zs = factor - xi;
+        if (Zs <= 0) return false;  /* can't be represented as (Xc / Zc, Yc / Zc) */
+        x = factor * mx / Zs;
+        y = factor * my / Zs;
+        return true;
+    }
+};
+
+
+/***
+* Coarse spatial buckets (uniform grid) of a point cloud for CameraModelT::CullPoints
+*   Build once for a static point cloud, then use it for every camera pose
+*   Non-finite points are not stored (they are never visible)
+***/
+template <typename Scalar>
+struct PointBucketT {
+    struct Bucket {
+        cv::Vec<Scalar, 3> min;     /* AABB of the points in the bucket */
+        cv::Vec<Scalar, 3> max;
+        int32_t begin;              /* range in index_list */
+        int32_t end;
+    };
+    std::vector<Bucket> bucket_list;
+    std::vector<int32_t> index_list;    /* point indices sorted by bucket */
+
+    void Build(const std::vector<cv::Point3_<Scalar>>& object_point_list, Scalar bucket_size);
+};
+
+/* Instantiated in camera_model.cpp */
+extern template struct PointBucketT<float>;
+extern template struct PointBucketT<double>;
+
+typedef PointBucketT<float> PointBucket;
+typedef PointBucketT<double> PointBucketD;
+
+
+/***
+* Scalar = float or double
+*   float: fast. Use this for most cases (CameraModel)
+*   double: precise. Use this for calibration and long-range distance (CameraModelD)
+* Projection = PinholeProjection or UnifiedProjection
+* Implementation is in camera_model.cpp, and only the above combinations are instantiated (in common library)
+***/
+template <typename Scalar, typename Projection = PinholeProjection>
+class CameraModelT {
+    static_assert(std::is_same<Scalar, float>::value || std::is_same<Scalar, double>::value, "Scalar must be float or double");
     /***
     * s[x, y, 1] = K * [R t] * [Mw, 1]
     *     K: カメラの内部パラメータ
@@ -63,435 +200,274 @@ class CameraModel {
     ***/
 
 public:
-    /*** Intrinsic parameters ***/
-    /* float, 3 x 3 */
-    cv::Mat K;
-    cv::Mat K_new;
-
-    int32_t width;
-    int32_t height;
-
-    /* float, 5 x 1 */
-    cv::Mat dist_coeff;
-
-    /*** Extrinsic parameters ***/
-    /* float, 3 x 1, pitch(rx),  yaw(ry), roll(rz) [rad] */
-    cv::Mat rvec;
-
-    /* float, 3 x 1, (tx, ty, tz): horizontal, vertical, depth (Camera location: Ow - Oc in camera coordinate) */
-    cv::Mat tvec;
+    typedef cv::Point_<Scalar> Point2;
+    typedef cv::Point3_<Scalar> Point3;
+    typedef cv::Vec<Scalar, 3> Vec3;
+    typedef cv::Vec<Scalar, 4> Vec4;
+    typedef cv::Matx<Scalar, 3, 3> Matx33;
+    typedef cv::Matx<Scalar, 2, 6> Matx26;
+    typedef cv::Matx<Scalar, 2, 3> Matx23;
+    typedef cv::Matx<Scalar, 2, 9> Matx29;
+    typedef PointBucketT<Scalar> PointBucket;
+    static constexpr int32_t kMatDepth = std::is_same<Scalar, double>::value ? CV_64F : CV_32F;
+    static constexpr Scalar kGroundPlaneMapDistanceRatio = Scalar(1.25);    /* max ratio of the distance in a cell of the ground plane map to interpolate */
 
 public:
-    CameraModel() {
+    CameraModelT() {
         /* Default Parameters */
-        SetIntrinsic(1280, 720, 500.0f);
-        SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+        SetIntrinsic(1280, 720, 500);
+        SetDist({ 0, 0, 0, 0, 0 });
+        SetXi(Projection::kIsUnified ? 1 : 0);
         //SetDist({ -0.1f, 0.01f, -0.005f, -0.001f, 0.0f });
         SetExtrinsic({ 0, 0, 0 }, { 0, 0, 0 });
     }
 
     /*** Accessor for camera parameters ***/
-    float& rx() { return rvec.at<float>(0); }   /* pitch */
-    float& ry() { return rvec.at<float>(1); }   /* yaw */
-    float& rz() { return rvec.at<float>(2); }   /* roll */
-    float& tx() { return tvec.at<float>(0); }
-    float& ty() { return tvec.at<float>(1); }
-    float& tz() { return tvec.at<float>(2); }
-    float& fx() { return K.at<float>(0); }
-    float& cx() { return K.at<float>(2); }
-    float& fy() { return K.at<float>(4); }
-    float& cy() { return K.at<float>(5); }
-
-
-    /*** Methods for camera parameters ***/
-    void SetIntrinsic(int32_t width, int32_t height, float focal_length) {
-        this->width = width;
-        this->height = height;
-        this->K = (cv::Mat_<float>(3, 3) <<
-            focal_length, 0, width / 2.f,
-            0, focal_length, height / 2.f,
-            0, 0, 1);
-        UpdateNewCameraMatrix();
+    /* Read only. Use the setters (SetIntrinsic, SetFocalLength, SetDist, SetExtrinsic, SetCameraPos, SetCameraAngle, etc.) to modify parameters */
+    Scalar rx() const { return rvec_[0]; }   /* pitch */
+    Scalar ry() const { return rvec_[1]; }   /* yaw */
+    Scalar rz() const { return rvec_[2]; }   /* roll */
+    Scalar tx() const { return tvec_[0]; }
+    Scalar ty() const { return tvec_[1]; }
+    Scalar tz() const { return tvec_[2]; }
+    Scalar fx() const { return K_(0, 0); }
+    Scalar cx() const { return K_(0, 2); }
+    Scalar fy() const { return K_(1, 1); }
+    Scalar cy() const { return K_(1, 2); }
+    std::array<Scalar, 5> GetDist() const {
+        return { dist_coeff_[0], dist_coeff_[1], dist_coeff_[2], dist_coeff_[3], dist_coeff_[4] };
     }
+    int32_t GetWidth() const { return width_; }
+    int32_t GetHeight() const { return height_; }
+    const Matx33& GetK() const { return K_; }
+    const Matx33& GetKNew() const { return K_new_; }
+    const cv::Vec<Scalar, 5>& GetDistCoeff() const { return dist_coeff_; }
+    Scalar GetXi() const { return xi_; }
+    const Vec3& GetRvec() const { return rvec_; }
+    const Vec3& GetTvec() const { return tvec_; }
+    Scalar GetLineReadoutTime() const { return line_readout_time_; }    /* 0 = global shutter */
+    /* The parameters are fixed-size types (cv::Matx / cv::Vec), so they can be passed to OpenCV functions (e.g. cv::projectPoints) as inputs without copy */
 
-    void SetDist(const std::array<float, 5>& dist) {
-        this->dist_coeff = (cv::Mat_<float>(5, 1) << dist[0], dist[1], dist[2], dist[3], dist[4]);
-        UpdateNewCameraMatrix();
-    }
+    /***
+    * Version of all the settings (camera parameters, rolling shutter, undistortion criteria, ground plane map, tables)
+    *   Changed by every setter, and unique in the process: cameras with the same version have the same settings (a copy keeps the version of its source)
+    ***/
+    uint64_t GetParameterVersion() const { return parameter_version_; }
 
-    void UpdateNewCameraMatrix()
-    {
-        if (!this->K.empty() && !this->dist_coeff.empty()) {
-            this->K_new = cv::getOptimalNewCameraMatrix(this->K, this->dist_coeff, cv::Size(this->width, this->height), 0.0);
-        }
-    }
+    /***
+    * Copy everything into dst without sharing memory (the copy constructor / operator= share cv::Mat buffers such as the ray table)
+    *   Buffers of dst are reused if the size is the same and dst is their only owner
+    ***/
+    void CopyTo(CameraModelT& dst) const;
 
-    void SetExtrinsic(const std::array<float, 3>& rvec_deg, const std::array<float, 3>& tvec, bool is_t_on_world = true)
-    {
-        this->rvec = (cv::Mat_<float>(3, 1) << Deg2Rad(rvec_deg[0]), Deg2Rad(rvec_deg[1]), Deg2Rad(rvec_deg[2]));
-        this->tvec = (cv::Mat_<float>(3, 1) << tvec[0], tvec[1], tvec[2]);
-
-        /*
-            is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
-            is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
-        */
-        if (is_t_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            this->tvec = -R * this->tvec;   /* t = -RT */
-        }
-    }
 
-    void GetExtrinsic(std::array<float, 3>& rvec_deg, std::array<float, 3>& tvec, bool is_t_on_world = true)
-    {
-        rvec_deg = { Rad2Deg(this->rvec.at<float>(0)), Rad2Deg(this->rvec.at<float>(1)) , Rad2Deg(this->rvec.at<float>(2)) };
-        tvec = { this->tvec.at<float>(0), this->tvec.at<float>(1), this->tvec.at<float>(2) };
-        /*
-            is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
-            is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
-        */
-        if (is_t_on_world) {
-            /* t = -RT -> T = -R^1 t */
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            cv::Mat R_inv;
-            cv::invert(R, R_inv);
-            cv::Mat T = -R_inv * this->tvec;
-            tvec = { T.at<float>(0), T.at<float>(1), T.at<float>(2) };
-        } else {
-            tvec = { this->tvec.at<float>(0), this->tvec.at<float>(1), this->tvec.at<float>(2) };
-        }
-        
-    }
+    /*** Methods for camera parameters ***/
+    /***
+    * Update parameters derived from the camera parameters now (they are updated lazily in conversion methods otherwise)
+    *   Call this before sharing a camera between threads: const conversion methods update the derived parameters when they are stale
+    *   Getters of camera parameters (GetExtrinsic, GetPose, etc.) never touch the derived parameters
+    ***/
+    void Prepare() { GetDerivedState(); }
 
-    void SetCameraPos(float tx, float ty, float tz, bool is_on_world = true)    /* Oc - Ow */
-    {
-        this->tvec = (cv::Mat_<float>(3, 1) << tx, ty, tz);
-        if (is_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            this->tvec = -R * this->tvec;   /* t = -RT */
-        } else {
-            /* Oc - Ow -> Ow - Oc */
-            this->tvec *= -1;
-        }
-    }
+    void SetIntrinsic(int32_t width, int32_t height, Scalar focal_length);
+    void SetIntrinsic(int32_t width, int32_t height, Scalar fx, Scalar fy, Scalar cx, Scalar cy);   /* e.g. result of calibration */
+    void SetFocalLength(Scalar fx, Scalar fy);
+    void SetDist(const std::array<Scalar, 5>& dist);
+    void SetXi(Scalar xi);
 
-    void MoveCameraPos(float dtx, float dty, float dtz, bool is_on_world = true)    /* Oc - Ow */
-    {
-        cv::Mat tvec_delta = (cv::Mat_<float>(3, 1) << dtx, dty, dtz);
-        if (is_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            tvec_delta = -R * tvec_delta;
-        } else {
-            /* Oc - Ow -> Ow - Oc */
-            tvec_delta *= -1;
-        }
-        this->tvec += tvec_delta;
-    }
+    /***
+    * Criteria for iterative undistortion (UndistortPoints)
+    *   max_iteration: the number of iterations (default = 5, which is the same as cv::undistortPoints)
+    *   epsilon: stop iteration when the update of normalized image coordinate (|dx| + |dy|) is less than this
+    *            0 = always run max_iteration times (no branch in the loop)
+    ***/
+    void SetUndistortionCriteria(int32_t max_iteration, Scalar epsilon = 0);
+    void UpdateNewCameraMatrix();
 
-    void SetCameraAngle(float pitch_deg, float yaw_deg, float roll_deg)
-    {
-        /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
-        cv::Mat R_old = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        cv::Mat T = -R_old.inv() * this->tvec;      /* T is tvec in world coordinate.  t = -RT */
-        this->rvec = (cv::Mat_<float>(3, 1) << Deg2Rad(pitch_deg), Deg2Rad(yaw_deg), Deg2Rad(roll_deg));
-        cv::Mat R_new = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        this->tvec = -R_new * T;   /* t = -RT */
-    }
+    /***
+    * Rolling shutter
+    *   The extrinsic parameters are the pose when row 0 is read out, and row y is read out at y * line_readout_time [sec]
+    *   linear_velocity: velocity of the camera in world coordinate [/sec] (the same unit as tvec)
+    *   angular_velocity_deg: rotation speed of the camera (pitch, yaw, roll) [deg/sec] (the same as RotateCameraAngle per second)
+    *   line_readout_time = 0: global shutter (default)
+    * The pose of each row is calculated once when parameters are updated, and used by ConvertWorld2Image and ConvertImage2GroundPlane
+    *   ConvertWorld2Image: the row where the point is read out is found iteratively
+    *   Other methods (ConvertWorld2Camera, CullPoints, etc.) use the pose of row 0
+    ***/
+    void SetRollingShutter(const std::array<Scalar, 3>& linear_velocity, const std::array<Scalar, 3>& angular_velocity_deg, Scalar line_readout_time);
+    void DisableRollingShutter() { SetRollingShutter({ 0, 0, 0 }, { 0, 0, 0 }, 0); }
 
-    void RotateCameraAngle(float dpitch_deg, float dyaw_deg, float droll_deg)
-    {
-        /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
-        cv::Mat R_old = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        cv::Mat T = -R_old.inv() * this->tvec;      /* T is tvec in world coordinate.  t = -RT */
-        cv::Mat R_delta = MakeRotationMat(dpitch_deg, dyaw_deg, droll_deg);
-        cv::Mat R_new = R_delta * R_old;
-        this->tvec = -R_new * T;   /* t = -RT */
-        cv::Rodrigues(R_new, this->rvec); /* Rotation matrix -> rvec */
-    }
+    void SetExtrinsic(const std::array<Scalar, 3>& rvec_deg, const std::array<Scalar, 3>& tvec, bool is_t_on_world = true);
+    void GetExtrinsic(std::array<Scalar, 3>& rvec_deg, std::array<Scalar, 3>& tvec, bool is_t_on_world = true) const;
+    void SetCameraPos(Scalar tx, Scalar ty, Scalar tz, bool is_on_world = true);    /* Oc - Ow */
+    void MoveCameraPos(Scalar dtx, Scalar dty, Scalar dtz, bool is_on_world = true);    /* Oc - Ow */
+    void SetCameraAngle(Scalar pitch_deg, Scalar yaw_deg, Scalar roll_deg);
+    void RotateCameraAngle(Scalar dpitch_deg, Scalar dyaw_deg, Scalar droll_deg);
+
+    /***
+    * Pose as a unit quaternion and the camera position
+    *   q: rotation from world coordinate to camera coordinate (the same as R = Rodrigues(rvec))
+    *   T: camera position in world coordinate (Oc - Ow)
+    *   The rotation is held as a quaternion internally, and rvec is updated from it in closed form (no cv::Rodrigues)
+    *   Projection uses R = cv::Rodrigues(rvec) (once per parameter update) to stay bit-compatible with cv::projectPoints
+    ***/
+    void SetPose(const Quaternion& q, const Vec3& T);
+    void GetPose(Quaternion& q, Vec3& T) const;
+    const Quaternion& GetRotation() const { return q_; }
 
     /*** Methods for projection ***/
-    void ConvertWorld2Image(const cv::Point3f& object_point, cv::Point2f& image_point)
-    {
-        std::vector<cv::Point3f> object_point_list = { object_point };
-        std::vector<cv::Point2f> image_point_list;
-        ConvertWorld2Image(object_point_list, image_point_list);
-        image_point = image_point_list[0];
-    }
+    void ConvertWorld2Image(const Point3& object_point, Point2& image_point) const;
+    void ConvertWorld2Image(const std::vector<Point3>& object_point_list, std::vector<Point2>& image_point_list) const;
+    void ConvertWorld2Image(const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, int32_t num, Scalar* u_list, Scalar* v_list) const;    /* structure of arrays */
 
-    void ConvertWorld2Image(const std::vector<cv::Point3f>& object_point_list, std::vector<cv::Point2f>& image_point_list)
-    {
-        /*** Mw -> Image ***/
-        /* the followings get exactly the same result */
-#if 1
-        /*** Projection ***/
-        /* s[x, y, 1] = K * [R t] * [M, 1] = K * M_from_cam */
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat Rt = (cv::Mat_<float>(3, 4) <<
-            R.at<float>(0), R.at<float>(1), R.at<float>(2), this->tx(),
-            R.at<float>(3), R.at<float>(4), R.at<float>(5), this->ty(),
-            R.at<float>(6), R.at<float>(7), R.at<float>(8), this->tz());
-
-        image_point_list.resize(object_point_list.size());
-
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& object_point = object_point_list[i];
-            auto& image_point = image_point_list[i];
-            cv::Mat Mw = (cv::Mat_<float>(4, 1) << object_point.x, object_point.y, object_point.z, 1);
-            cv::Mat Mc = Rt * Mw;
-            float Zc = Mc.at<float>(2);
-            if (Zc <= 0) {
-                /* Do not project points behind the camera */
-                image_point = cv::Point2f(-1, -1);
-                continue;
-            }
-
-            cv::Mat XY = K * Mc;
-            float x = XY.at<float>(0);
-            float y = XY.at<float>(1);
-            float s = XY.at<float>(2);
-            x /= s;
-            y /= s;
-
-            if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-                image_point.x = x;
-                image_point.y = y;
-            } else {
-                /*** Distort ***/
-                float u = (x - this->cx()) / this->fx();  /* from optical center*/
-                float v = (y - this->cy()) / this->fy();  /* from optical center*/
-                float r2 = u * u + v * v;
-                float r4 = r2 * r2;
-                float k1 = this->dist_coeff.at<float>(0);
-                float k2 = this->dist_coeff.at<float>(1);
-                float p1 = this->dist_coeff.at<float>(3);
-                float p2 = this->dist_coeff.at<float>(4);
-                u = u + u * (k1 * r2 + k2 * r4 /*+ k3 * r6 */) + (2 * p1 * u * v) + p2 * (r2 + 2 * u * u);
-                v = v + v * (k1 * r2 + k2 * r4 /*+ k3 * r6 */) + (2 * p2 * u * v) + p1 * (r2 + 2 * v * v);
-                image_point.x = u * this->fx() + this->cx();
-                image_point.y = v * this->fy() + this->cy();
-            }
-        }
-#else
-        cv::projectPoints(object_point_list, this->rvec, this->tvec, this->K, this->dist_coeff, image_point_list);
-#endif
-    }
+    /***
+    * Projection of a block of points on the calling thread (no allocation, no OpenMP)
+    *   depth_list: Zc of each point (optional)
+    *   Call Prepare() before calling it from multiple threads
+    ***/
+    void ConvertWorld2ImageBlock(const Point3* object_point_list, int32_t num, Point2* image_point_list, Scalar* depth_list = nullptr) const;
 
-    void ConvertWorld2Camera(const std::vector<cv::Point3f>& object_point_in_world_list, std::vector<cv::Point3f>& object_point_in_camera_list)
-    {
-        /*** Mw -> Mc ***/
-        /* Mc = [R t] * [M, 1] */
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat Rt = (cv::Mat_<float>(3, 4) <<
-            R.at<float>(0), R.at<float>(1), R.at<float>(2), this->tx(),
-            R.at<float>(3), R.at<float>(4), R.at<float>(5), this->ty(),
-            R.at<float>(6), R.at<float>(7), R.at<float>(8), this->tz());
-
-        object_point_in_camera_list.resize(object_point_in_world_list.size());
-
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_in_world_list.size(); i++) {
-            const auto& object_point_in_world = object_point_in_world_list[i];
-            auto& object_point_in_camera = object_point_in_camera_list[i];
-            cv::Mat Mw = (cv::Mat_<float>(4, 1) << object_point_in_world.x, object_point_in_world.y, object_point_in_world.z, 1);
-            cv::Mat Mc = Rt * Mw;
-            object_point_in_camera.x = Mc.at<float>(0);
-            object_point_in_camera.y = Mc.at<float>(1);
-            object_point_in_camera.z = Mc.at<float>(2);
-        }
-    }
+    /***
+    * Projection with analytic Jacobians (calculated in the same pass as projection, for iterative solvers)
+    *   jacobian_pose_list: 2 x 6 for each point. d(u, v) / d(wx, wy, wz, tx, ty, tz)
+    *     (wx, wy, wz): small rotation in camera coordinate applied to R (R' = Exp(w) * R, tvec is kept) [rad]
+    *     (tx, ty, tz): tvec
+    *   jacobian_point_list: 2 x 3 for each point. d(u, v) / d(Xw, Yw, Zw)
+    *   jacobian_intrinsic_list: 2 x 9 for each point. d(u, v) / d(fx, fy, cx, cy, k1, k2, p1, p2, k3) (optional. xi is not included)
+    *   Points behind the camera are (-1, -1) with zero Jacobians. Rolling shutter is ignored (the pose of row 0 is used)
+    ***/
+    void ConvertWorld2ImageJacobian(const std::vector<Point3>& object_point_list, std::vector<Point2>& image_point_list,
+        std::vector<Matx26>& jacobian_pose_list, std::vector<Matx23>& jacobian_point_list, std::vector<Matx29>* jacobian_intrinsic_list = nullptr) const;
 
-    void ConvertCamera2World(const std::vector<cv::Point3f>& object_point_in_camera_list, std::vector<cv::Point3f>& object_point_in_world_list)
-    {
-        /*** Mc -> Mw ***/
-        /* Mc = [R t] * [Mw, 1] */
-        /* -> [M, 1] = [R t]^1 * Mc <- Unable to get the inverse of [R t] because it's 4x3 */
-        /* So, Mc = R * Mw + t */
-        /* -> Mw = R^1 * (Mc - t) */
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat R_inv;
-        cv::invert(R, R_inv);
-        cv::Mat t = this->tvec;
+    /***
+    * Frustum culling
+    *   index_list: indices of points which can be visible (in front of the camera and inside the image extended by margin_px. margin_px is converted with fx, fy)
+    *   Points are only transformed into camera coordinate and normalized (no lens distortion), so it's much cheaper than ConvertWorld2Image
+    *   The result is conservative: a few points in index_list may be out of the image after projection, so check the projected points as usual
+    *   Without bucket: index_list is in ascending order
+    *   With bucket: buckets out of the frustum are skipped, and points in buckets inside the frustum are accepted without the test
+    *                index_list is in bucket order. Buckets are tested for PinholeProjection only (all points are tested for UnifiedProjection)
+    ***/
+    void CullPoints(const std::vector<Point3>& object_point_list, std::vector<int32_t>& index_list, Scalar margin_px = 0) const;
+    void CullPoints(const std::vector<Point3>& object_point_list, const PointBucket& bucket, std::vector<int32_t>& index_list, Scalar margin_px = 0) const;
 
+    void ConvertWorld2Camera(const std::vector<Point3>& object_point_in_world_list, std::vector<Point3>& object_point_in_camera_list) const;
+    void ConvertCamera2World(const std::vector<Point3>& object_point_in_camera_list, std::vector<Point3>& object_point_in_world_list) const;
 
-        object_point_in_world_list.resize(object_point_in_camera_list.size());
+    void ConvertImage2GroundPlane(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list);
+    void ConvertImage2GroundPlaneDirect(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list) const;
+    void ConvertImage2GroundPlaneByMap(const std::vector<Point2>& image_point_list, std::vector<Point3>& object_point_list);
 
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_in_camera_list.size(); i++) {
-            const auto& object_point_in_camera = object_point_in_camera_list[i];
-            auto& object_point_in_world = object_point_in_world_list[i];
-            cv::Mat Mc = (cv::Mat_<float>(3, 1) << object_point_in_camera.x, object_point_in_camera.y, object_point_in_camera.z);
-            cv::Mat Mw = R_inv * (Mc - t);
-            object_point_in_world.x = Mw.at<float>(0);
-            object_point_in_world.y = Mw.at<float>(1);
-            object_point_in_world.z = Mw.at<float>(2);
-        }
-    }
+    /***
+    * Image -> Mw on arbitrary planes (e.g. walls, sloped road segments)
+    *   plane_list: (nx, ny, nz, d) for n . Mw + d = 0 in world coordinate. e.g. ground: (0, 1, 0, 0), wall at Zw = 10: (0, 0, 1, -10)
+    *   object_point_list[plane_index][point_index]: intersection of the ray and the plane
+    *   is_hit_list[plane_index][point_index]: 0 if the ray doesn't hit the plane in front of the camera (the point is (0, 0, 0))
+    *   Image points are undistorted once for all planes, and constants of each plane are calculated once per call
+    ***/
+    void ConvertImage2Plane(const std::vector<Point2>& image_point_list, const std::vector<Vec4>& plane_list,
+        std::vector<std::vector<Point3>>& object_point_list, std::vector<std::vector<uint8_t>>& is_hit_list) const;
 
-    void ConvertImage2GroundPlane(const std::vector<cv::Point2f>& image_point_list, std::vector<cv::Point3f>& object_point_list)
-    {
-        /*** Image -> Mw ***/
-        /*** Calculate point in ground plane (in world coordinate) ***/
-        /* Main idea:*/
-        /*   s * [x, y, 1] = K * [R t] * [M, 1]  */
-        /*   s * [x, y, 1] = K * R * M + K * t */
-        /*   s * Kinv * [x, y, 1] = R * M + t */
-        /*   s * Kinv * [x, y, 1] - t = R * M */
-        /*   Rinv * (s * Kinv * [x, y, 1] - t) = M */
-        /* calculate s */
-        /*   s * Rinv * Kinv * [x, y, 1] = M + R_inv * t */
-        /*      where, M = (X, Y, Z), and we assume Y = 0(ground_plane) */
-        /*      so , we can solve left[1] = R_inv * t[1](camera_height) */
-
-        if (image_point_list.size() == 0) return;
-
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat K_inv;
-        cv::invert(K, K_inv);
-        cv::Mat R_inv;
-        cv::invert(R, R_inv);
-        cv::Mat t = this->tvec;
-
-        /*** Undistort image point ***/
-        std::vector<cv::Point2f> image_point_undistort;
-        if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-            image_point_undistort = image_point_list;
-        } else {
-            cv::undistortPoints(image_point_list, image_point_undistort, this->K, this->dist_coeff, this->K);    /* don't use K_new */
-        }
+    /***
+    * Use a precomputed map for ConvertImage2GroundPlane
+    *   The map has world (X, Z) on the ground plane for every "subsample" pixels, and values between them are bilinear interpolated
+    *   The map is re-generated only when camera parameters are changed
+    *   Points outside the image, and points in cells near the horizon are calculated without the map (ConvertImage2GroundPlaneDirect)
+    *     near the horizon: a grid point of the cell is above the horizon, or the distance from the camera differs by more than kGroundPlaneMapDistanceRatio in the cell
+    *   Interpolation error for the other points: the distance is proportional to 1 / dy (dy: pixels from the horizon), so it's not linear in the image
+    *     Relative error of the distance <= (r - 1)^2 / (4 * r)  (r: ratio of the distance in the cell) = 1.25% for r = 1.25
+    *     e.g. subsample = 4: 0.83% at dy = 20 px, 0.04% at dy = 100 px (pinhole, no roll. lens distortion adds a little)
+    ***/
+    void EnableGroundPlaneMap(int32_t subsample = 1);
+    void DisableGroundPlaneMap();
 
-        object_point_list.resize(image_point_list.size());
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& image_point = image_point_list[i];
-            auto& object_point = object_point_list[i];
-
-            float x = image_point_undistort[i].x;
-            float y = image_point_undistort[i].y;
-            if (y < EstimateVanishmentY()) {
-                object_point.x = 999;
-                object_point.y = 999;
-                object_point.z = 999;
-                continue;
-            }
-
-            cv::Mat XY = (cv::Mat_<float>(3, 1) << x, y, 1);
-
-            /* calculate s */
-            cv::Mat LEFT_WO_S = R_inv * K_inv * XY;
-            cv::Mat RIGHT_WO_M = R_inv * t;         /* no need to add M because M[1] = 0 (ground plane)*/
-            float s = RIGHT_WO_M.at<float>(1) / LEFT_WO_S.at<float>(1);
-
-            /* calculate M */
-            cv::Mat TEMP = R_inv * (s * K_inv * XY - t);
-
-            object_point.x = TEMP.at<float>(0);
-            object_point.y = TEMP.at<float>(1);
-            object_point.z = TEMP.at<float>(2);
-            if (object_point.z < 0) object_point.z = 999;
-        }
-    }
+    /***
+    * Ground plane map
+    *   Scalar, (height / subsample + 2) x (width / subsample + 2) x 3: (Xw, Zw, is_valid)
+    *   is_valid = 0 (Xw = Zw = 0) for points above the horizon or behind the camera
+    ***/
+    const cv::Mat& GetGroundPlaneMap();
 
-    void ConvertImage2Camera(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list)
-    {
-        /*** Image -> Mc ***/
-        if (image_point_list.size() == 0) {
-            /* Convert for all pixels on image, when image_point_list = empty */
-            if (z_list.size() != this->width * this->height) {
-                printf("[ConvertImage2Camera] Invalid z_list size\n");
-                return;
-            }
-            /* Generate the original image point mat */
-            /* todo: no need to generate every time */
-            for (int32_t y = 0; y < this->height; y++) {
-                for (int32_t x = 0; x < this->width; x++) {
-                    image_point_list.push_back(cv::Point2f(float(x), float(y)));
-                }
-            }
-        } else {
-            /* Convert for the input pixels only */
-            if (z_list.size() != image_point_list.size()) {
-                printf("[ConvertImage2Camera] Invalid z_list size\n");
-                return;
-            }
-        }
+    void ConvertImage2Camera(const std::vector<Point2>& image_point_list, const std::vector<Scalar>& z_list, std::vector<Point3>& object_point_list);
+    void ConvertImage2World(const std::vector<Point2>& image_point_list, const std::vector<Scalar>& z_list, std::vector<Point3>& object_point_list);
 
-        /*** Undistort image point ***/
-        std::vector<cv::Point2f> image_point_undistort;
-        if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-            image_point_undistort = image_point_list;   /* todo: redundant copy. I do this just because to make code simple */
-        } else {
-            cv::undistortPoints(image_point_list, image_point_undistort, this->K, this->dist_coeff, this->K);    /* don't use K_new */
-        }
+    /***
+    * Ray table: undistorted normalized image coordinate ((x - cx) / fx, (y - cy) / fy for pinhole) for each pixel
+    *   Scalar, height x width x 2
+    *   Mc = Zc * (ray.x, ray.y, 1)
+    *   NaN for pixels which don't have a ray in front of the camera (unified projection model only)
+    * It depends on intrinsic parameters only, so it's re-generated only when they are changed
+    ***/
+    const cv::Mat& GetRayTable();
 
-        object_point_list.resize(image_point_list.size());
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& Zc = z_list[i];
-            auto& object_point = object_point_list[i];
-
-            float x = image_point_undistort[i].x;
-            float y = image_point_undistort[i].y;
-
-            float u = x - this->cx();
-            float v = y - this->cy();
-            float Xc = Zc * u / this->fx();
-            float Yc = Zc * v / this->fy();
-            object_point.x = Xc;
-            object_point.y = Yc;
-            object_point.z = Zc;
-        }
-    }
+    /***
+    * Use precomputed tables (e.g. memory mapped by CameraBundle) instead of generating them
+    *   The table must be generated with the current parameters, and it's used until the related parameters are changed
+    *   The table is not copied. storage keeps the memory of the table alive (nullptr if the table owns its memory)
+    *   return false if the size / type doesn't match (the table is generated as usual in that case)
+    ***/
+    bool SetRayTable(const cv::Mat& ray_table, const std::shared_ptr<const void>& storage = nullptr);
+    bool SetGroundPlaneMap(const cv::Mat& ground_plane_map, int32_t subsample, const std::shared_ptr<const void>& storage = nullptr);
 
-    void ConvertImage2World(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list)
-    {
-        /*** Image -> Mw ***/
-        std::vector<cv::Point3f> object_point_in_camera_list;
-        ConvertImage2Camera(image_point_list, z_list, object_point_in_camera_list);
-        ConvertCamera2World(object_point_in_camera_list, object_point_list);
-    }
+    /***
+    * Remove lens distortion (k1, k2, p1, p2, k3)
+    *   Image point -> normalized image coordinate without distortion ((x - cx) / fx, (y - cy) / fy for no distortion)
+    *   ray_list can be the same buffer as image_point_list (in-place)
+    *   For UnifiedProjection, the output is on the normalized plane of the unified model (not lifted to the ray)
+    ***/
+    void UndistortPoints(const Point2* image_point_list, int32_t num, Point2* ray_list) const;
+
+    /***
+    * Create maps for cv::remap to convert the image of this camera into a pinhole image without distortion
+    *   undist_image_size, K_undist: intrinsic parameters of the output (pinhole) image
+    *   mapx, mapy: float, CV_32FC1 (-1 for pixels which are not visible from this camera)
+    ***/
+    void CreateUndistortMap(const cv::Size& undist_image_size, const Matx33& K_undist, cv::Mat& mapx, cv::Mat& mapy);
 
 
     /* tan(theta) = delta / f */
-    float EstimatePitch(float vanishment_y)
+    Scalar EstimatePitch(Scalar vanishment_y) const
     {
-        float pitch = std::atan2(this->cy() - vanishment_y, this->fy());
+        Scalar pitch = std::atan2(this->cy() - vanishment_y, this->fy());
         return Rad2Deg(pitch);
     }
 
-    float EstimateYaw(float vanishment_x)
+    Scalar EstimateYaw(Scalar vanishment_x) const
     {
-        float yaw = std::atan2(this->cx() - vanishment_x, this->fx());
+        Scalar yaw = std::atan2(this->cx() - vanishment_x, this->fx());
         return Rad2Deg(yaw);
     }
 
-    int32_t EstimateVanishmentY()
+    int32_t EstimateVanishmentY() const
     {
-        float fy = this->fy();
-        float cy = this->cy();
-        //float fy = this->K_new.at<float>(4);
-        //float cy = this->K_new.at<float>(5);
-        float px_from_center = std::tan(this->rx()) * fy;
-        float vanishment_y = cy - px_from_center;
+        Scalar fy = this->fy();
+        Scalar cy = this->cy();
+        //Scalar fy = K_new_(1, 1);
+        //Scalar cy = K_new_(1, 2);
+        Scalar px_from_center = std::tan(this->rx()) * fy;
+        Scalar vanishment_y = cy - px_from_center;
         return static_cast<int32_t>(vanishment_y);
     }
 
-    int32_t EstimateVanishmentX()
+    int32_t EstimateVanishmentX() const
     {
-        float px_from_center = std::tan(this->ry()) * this->fx();
-        float vanishment_x = this->cx() - px_from_center;
+        Scalar px_from_center = std::tan(this->ry()) * this->fx();
+        Scalar vanishment_x = this->cx() - px_from_center;
         return static_cast<int32_t>(vanishment_x);
     }
 
+    /***
+    * Refine pitch and height of the camera (e.g. change of vehicle load) by Levenberg-Marquardt, starting from the current pose
+    *   image_point_list, object_point_list: correspondences of points on the ground plane (Yw = 0)
+    *   lane_list: image points on each lane line. Each line is straight and parallel to Zw axis on the ground plane (its lateral position is unknown)
+    *   Yaw, roll and the horizontal position are fixed. Height is refined only when there are point correspondences (lane lines don't constrain it)
+    *   Residuals are on undistorted normalized image coordinate with analytic Jacobians, and observations are undistorted only once
+    *   Rolling shutter is ignored (the pose of row 0 is refined)
+    *   return RMS of residuals after refinement, or -1 if there are not enough constraints (the pose is not modified)
+    ***/
+    Scalar RefineExtrinsicOnGround(const std::vector<Point2>& image_point_list, const std::vector<Point3>& object_point_list,
+        const std::vector<std::vector<Point2>>& lane_list = {}, int32_t max_iteration = 10);
+
 
     /*** Other methods ***/
     template <typename T = float>
@@ -502,59 +478,268 @@ public:
         }
     }
 
-    template <typename T = float>
-    static cv::Mat MakeRotationMat(T x_deg, T y_deg, T z_deg)
+    template <typename T = Scalar>
+    static cv::Matx<T, 3, 3> MakeRotationMat(T x_deg, T y_deg, T z_deg)
     {
         T x_rad = Deg2Rad(x_deg);
         T y_rad = Deg2Rad(y_deg);
         T z_rad = Deg2Rad(z_deg);
 #if 0
         /* Rotation Matrix with Euler Angle */
-        cv::Mat R_x = (cv::Mat_<T>(3, 3) <<
+        cv::Matx<T, 3, 3> R_x(
             1, 0, 0,
             0, std::cos(x_rad), -std::sin(x_rad),
             0, std::sin(x_rad), std::cos(x_rad));
 
-        cv::Mat R_y = (cv::Mat_<T>(3, 3) <<
+        cv::Matx<T, 3, 3> R_y(
             std::cos(y_rad), 0, std::sin(y_rad),
             0, 1, 0,
             -std::sin(y_rad), 0, std::cos(y_rad));
 
-        cv::Mat R_z = (cv::Mat_<T>(3, 3) <<
+        cv::Matx<T, 3, 3> R_z(
             std::cos(z_rad), -std::sin(z_rad), 0,
             std::sin(z_rad), std::cos(z_rad), 0,
             0, 0, 1);
 
-        cv::Mat R = R_z * R_x * R_y;
+        cv::Matx<T, 3, 3> R = R_z * R_x * R_y;
 #else
         /* Rodrigues */
-        cv::Mat rvec = (cv::Mat_<T>(3, 1) << x_rad, y_rad, z_rad);
-        cv::Mat R;
+        cv::Vec<T, 3> rvec(x_rad, y_rad, z_rad);
+        cv::Matx<T, 3, 3> R;
         cv::Rodrigues(rvec, R);
 #endif
         return R;
     }
 
-    static void RotateObject(float x_deg, float y_deg, float z_deg, std::vector<cv::Point3f>& object_point_list)
+    /***
+    * Rigid transform of points in place: M' = R * M + t (one pass over the points, no allocation)
+    *   A chain of transforms is composed in advance by ComposeTransform, then applied at once
+    *   Blocks of points are processed in parallel (OpenMP) for large point clouds
+    ***/
+    static void TransformObject(const Matx33& R, const Vec3& t, std::vector<Point3>& object_point_list);
+    static void TransformObject(const Matx33& R, const Vec3& t, Point3* object_point_list, int32_t num);
+
+    /* (R, t) = (R2, t2) after (R1, t1): R2 * (R1 * M + t1) + t2 */
+    static void ComposeTransform(const Matx33& R1, const Vec3& t1, const Matx33& R2, const Vec3& t2, Matx33& R, Vec3& t)
     {
-        cv::Mat R = MakeRotationMat(x_deg, y_deg, z_deg);
-        for (auto& object_point : object_point_list) {
-            cv::Mat p = (cv::Mat_<float>(3, 1) << object_point.x, object_point.y, object_point.z);
-            p = R * p;
-            object_point.x = p.at<float>(0);
-            object_point.y = p.at<float>(1);
-            object_point.z = p.at<float>(2);
+        R = R2 * R1;
+        t = R2 * t1 + t2;
+    }
+
+    /* Rotation / translation only (TransformObject) */
+    static void RotateObject(Scalar x_deg, Scalar y_deg, Scalar z_deg, std::vector<Point3>& object_point_list);
+    static void MoveObject(Scalar x, Scalar y, Scalar z, std::vector<Point3>& object_point_list);
+
+private:
+    /*** Batch projection kernel ***/
+    /***
+    * All parameters are converted to double and the calculation follows the same order as cv::projectPoints,
+    * so that the result is the same as cv::projectPoints (except that points behind the camera are set to (-1, -1))
+    ***/
+    struct ProjectionParameter {
+        double R[9];
+        double t[3];
+        double fx, fy, cx, cy;
+        double k1, k2, p1, p2, k3;
+        bool has_distortion;
+        double xi;
+        double z_limit;     /* for UnifiedProjection */
+        int32_t row_num;    /* the number of rows of RowPose (0 = global shutter) */
+    };
+
+    /* Pose for each row (rolling shutter) */
+    struct RowPose {
+        double R[9];        /* for the projection kernel */
+        double t[3];
+        Matx33 R_inv;       /* for back-projection */
+        Vec3 tvec;
+        Vec3 R_inv_t;
+    };
+
+    /* Intrinsic parameters used as a key of caches which depend on intrinsic parameters only */
+    struct IntrinsicKey {
+        int32_t width;
+        int32_t height;
+        std::array<Scalar, 4> K;     /* fx, fy, cx, cy */
+        std::array<Scalar, 5> dist;
+        Scalar xi;
+        int32_t undistortion_max_iteration;
+        Scalar undistortion_epsilon;
+        bool operator==(const IntrinsicKey& other) const {
+            return width == other.width && height == other.height && K == other.K && dist == other.dist && xi == other.xi
+                && undistortion_max_iteration == other.undistortion_max_iteration && undistortion_epsilon == other.undistortion_epsilon;
         }
+    };
+
+    IntrinsicKey MakeIntrinsicKey() const
+    {
+        IntrinsicKey key;
+        key.width = width_;
+        key.height = height_;
+        key.K = { this->fx(), this->fy(), this->cx(), this->cy() };
+        key.dist = GetDist();
+        key.xi = xi_;
+        key.undistortion_max_iteration = undistortion_max_iteration_;
+        key.undistortion_epsilon = undistortion_epsilon_;
+        return key;
+    }
+
+    /* Range of normalized image coordinate (before lens distortion) which is projected inside the image (for frustum culling) */
+    struct FrustumBound {
+        double x_min, x_max;
+        double y_min, y_max;
+    };
+
+    /*** Derived parameters ***/
+    /***
+    * Calculated from the camera parameters only when they are updated via the setters, and used by the conversion methods
+    * They are mutable so that const conversion methods can update them lazily.
+    * Once they are updated (Prepare()), const methods don't write anything, so a const CameraModel can be shared between threads
+    ***/
+    struct DerivedState {
+        Matx33 R;
+        Matx33 R_inv;
+        Vec3 R_inv_t;
+        ProjectionParameter projection_param;
+        std::vector<RowPose> row_pose_list;     /* empty for global shutter */
+        FrustumBound frustum_bound;             /* margin = 0 */
+        IntrinsicKey frustum_bound_key;         /* frustum_bound is re-calculated only when intrinsic parameters are changed */
+        bool has_frustum_bound = false;
+    };
+
+    mutable DerivedState derived_state_;
+    mutable bool is_derived_state_dirty_ = true;
+    mutable uint32_t derived_state_version_ = 0;    /* incremented every update, to check if caches depending on all parameters are valid */
+
+    void InvalidateDerivedState()
+    {
+        is_derived_state_dirty_ = true;
+        UpdateParameterVersion();
+    }
+
+    uint64_t parameter_version_ = 0;
+    void UpdateParameterVersion()
+    {
+        static std::atomic<uint64_t> s_parameter_version{ 0 };
+        parameter_version_ = ++s_parameter_version;
     }
 
-    static void MoveObject(float x, float y, float z, std::vector<cv::Point3f>& object_point_list)
+    const DerivedState& GetDerivedState() const
     {
-        for (auto& object_point : object_point_list) {
-            object_point.x += x;
-            object_point.y += y;
-            object_point.z += z;
+        if (is_derived_state_dirty_) {
+            UpdateDerivedState();
+            is_derived_state_dirty_ = false;
+            derived_state_version_++;
         }
+        return derived_state_;
     }
+
+    void UpdateDerivedState() const;
+
+    /* T = -R^-1 t (Oc - Ow in world coordinate), calculated from q_ directly so that const getters don't update derived_state_ */
+    Vec3 GetCameraPosOnWorld() const
+    {
+        const Matx33 R_inv(this->q_.ToRotationMatrix().t());
+        return -(R_inv * tvec_);
+    }
+
+    /*** Ray table ***/
+    cv::Mat ray_table_;
+    IntrinsicKey ray_table_key_;
+    std::shared_ptr<const void> ray_table_storage_;     /* for external memory set by SetRayTable */
+
+    void UpdateRayTable();
+
+    /* Image point -> undistorted normalized image coordinate (ray). NaN if the ray doesn't exist */
+    void ConvertImage2Ray(const std::vector<Point2>& image_point_list, std::vector<Point2>& ray_list) const;
+
+    /*** Intrinsic parameters ***/
+    /***
+    * Private, so that every modification goes through the setters and the derived parameters (R, ray table, ground plane map, etc.) are invalidated
+    * All parameters are fixed-size types (cv::Matx / cv::Vec), so they are on the stack (no heap allocation) and copying CameraModel is cheap.
+    ***/
+    /* Scalar, 3 x 3 */
+    Matx33 K_;
+    Matx33 K_new_;
+
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+
+    /* Scalar, 5 x 1 */
+    cv::Vec<Scalar, 5> dist_coeff_;
+
+    /* Unified projection model only (ignored by PinholeProjection) */
+    Scalar xi_ = 0;
+
+    /*** Extrinsic parameters ***/
+    /* Scalar, 3 x 1, pitch(rx),  yaw(ry), roll(rz) [rad] */
+    Vec3 rvec_;
+
+    /* Scalar, 3 x 1, (tx, ty, tz): horizontal, vertical, depth (Camera location: Ow - Oc in camera coordinate) */
+    Vec3 tvec_;
+
+    /*** Rotation (the same as rvec) ***/
+    Quaternion q_;
+
+    /*** Rolling shutter ***/
+    Vec3 linear_velocity_ = Vec3(0, 0, 0);
+    Vec3 angular_velocity_ = Vec3(0, 0, 0);    /* [rad/sec] */
+    Scalar line_readout_time_ = 0;
+
+    /*** Undistortion ***/
+    int32_t undistortion_max_iteration_ = 5;
+    Scalar undistortion_epsilon_ = 0;
+
+    static void UndistortBatch(const ProjectionParameter& param, int32_t max_iteration, double epsilon, const Point2* image_point_list, int32_t num, Point2* ray_list);
+
+    template <bool kUseEpsilon>
+    static void UndistortKernel(const ProjectionParameter& param, int32_t max_iteration, double epsilon, const Point2* image_point_list, Point2* ray_list, int32_t offset, int32_t size);
+
+    /*** Frustum culling ***/
+    void UpdateFrustumBound(DerivedState& state) const;
+    FrustumBound GetFrustumBound(Scalar margin_px) const;
+
+    /* return 1 if the point can be visible */
+    static inline uint8_t IsInFrustum(const ProjectionParameter& param, const FrustumBound& bound, double Xw, double Yw, double Zw)
+    {
+        const double Xc = param.R[0] * Xw + param.R[1] * Yw + param.R[2] * Zw + param.t[0];
+        const double Yc = param.R[3] * Xw + param.R[4] * Yw + param.R[5] * Zw + param.t[1];
+        const double Zc = param.R[6] * Xw + param.R[7] * Yw + param.R[8] * Zw + param.t[2];
+        double x, y;
+        const bool is_front = Projection::Normalize(param.xi, param.z_limit, Xc, Yc, Zc, x, y);
+        return (is_front && x >= bound.x_min && x <= bound.x_max && y >= bound.y_min && y <= bound.y_max) ? 1 : 0;
+    }
+
+    /*** Ground plane map ***/
+    cv::Mat ground_plane_map_;
+    int32_t ground_plane_map_subsample_ = 0;    /* 0 = don't use the map */
+    uint32_t ground_plane_map_version_ = 0;
+    std::shared_ptr<const void> ground_plane_map_storage_;     /* for external memory set by SetGroundPlaneMap */
+
+    void UpdateGroundPlaneMap();
+
+    template <int32_t kInStride, int32_t kOutStride>
+    static void ProjectBatch(const ProjectionParameter& param, const RowPose* row_pose_list, const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, Scalar* u_list, Scalar* v_list, int32_t num);
+
+    template <bool kHasDistortion, int32_t kInStride, int32_t kOutStride, bool kOutputDepth = false>
+    static void ProjectKernel(const ProjectionParameter& param, const RowPose* row_pose_list, const Scalar* x_list, const Scalar* y_list, const Scalar* z_list, Scalar* u_list, Scalar* v_list, int32_t offset, int32_t size, Scalar* depth_list = nullptr);
+
+    template <bool kHasDistortion>
+    static void JacobianKernel(const ProjectionParameter& param, const Point3* object_point_list, Point2* image_point_list, Matx26* jacobian_pose_list, Matx23* jacobian_point_list, Matx29* jacobian_intrinsic_list, int32_t offset, int32_t size);
+
+    template <bool kHasDistortion>
+    static bool ProjectCameraPoint(const ProjectionParameter& param, double Xc, double Yc, double Zc, double& u, double& v);
 };
 
+/* Instantiated in camera_model.cpp */
+extern template class CameraModelT<float, PinholeProjection>;
+extern template class CameraModelT<double, PinholeProjection>;
+extern template class CameraModelT<float, UnifiedProjection>;
+extern template class CameraModelT<double, UnifiedProjection>;
+
+typedef CameraModelT<float> CameraModel;
+typedef CameraModelT<double> CameraModelD;
+typedef CameraModelT<float, UnifiedProjection> CameraModelUnified;
+typedef CameraModelT<double, UnifiedProjection> CameraModelUnifiedD;
+
 #endif
@@ -0,0 +1,231 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+#include "camera_model_fixed_point.h"
+
+/*** Macro ***/
+static constexpr int32_t kQR = 30;     /* Q of R */
+static constexpr int64_t kNormalizedLimit = 8;      /* |Xc / Zc|, |Yc / Zc| */
+static constexpr int64_t kRR2Limit = int64_t(16) << CameraModelFixedPoint::kQ;     /* r^2 for lens distortion (to avoid overflow of k3 * r^6) */
+static constexpr int64_t kDistortedLimit = int64_t(256) << CameraModelFixedPoint::kQ;  /* to avoid overflow of fx * xd (far outside the image) */
+
+
+/*** Function ***/
+/* value / 2^shift, rounded (shift > 0) */
+static inline int64_t RoundShift(int64_t value, int32_t shift)
+{
+    return (value + (int64_t(1) << (shift - 1))) >> shift;
+}
+
+/* num / den, rounded (den > 0) */
+static inline int64_t RoundDiv(int64_t num, int64_t den)
+{
+    return (num >= 0 ? num + den / 2 : num - den / 2) / den;
+}
+
+/***
+* Reciprocal of den (> 0) without division
+*   den = m * 2^-shift, m in [2^30, 2^31) (d = m / 2^31 in [0.5, 1))
+*   return 1 / d in Q30 (2^61 / m), whose relative error is less than 2^-29
+*   Initial value 48/17 - 32/17 * d (error < 1/17), then 3 iterations of Newton-Raphson r = r * (2 - d * r) (error is squared by each iteration)
+*   All multiplications are 32 bit x 32 bit -> 64 bit (one instruction on 32-bit CPUs)
+***/
+static inline uint32_t Reciprocal(int64_t den, int32_t& shift)
+{
+    shift = 0;
+    while (den >= (int64_t(1) << 31)) {
+        den >>= 1;
+        shift--;
+    }
+    uint32_t m = static_cast<uint32_t>(den);
+    for (int32_t k = 16; k > 0; k >>= 1) {
+        if (m < (uint32_t(1) << (31 - k))) {
+            m <<= k;
+            shift += k;
+        }
+    }
+    uint32_t r = 3031741621u - static_cast<uint32_t>((uint64_t(2021161081u) * m) >> 31);   /* 48/17, 32/17 in Q30 */
+    for (int32_t i = 0; i < 3; i++) {
+        const uint32_t e = (uint32_t(2) << 30) - static_cast<uint32_t>((uint64_t(m) * r) >> 31);    /* 2 - d * r (Q30) */
+        r = static_cast<uint32_t>((uint64_t(r) * e) >> 30);
+    }
+    return r;
+}
+
+/* num / den in Q16, rounded (|num| <= 8 * den). reciprocal, shift: result of Reciprocal(den) */
+static inline int64_t MultiplyReciprocal(int64_t num, uint32_t reciprocal, int32_t shift)
+{
+    /* num / den = (num * 2^shift) / m = (num * 2^shift) * (2^59 / m) / 2^59. |num * 2^shift| <= 8 * m < 2^34, so the product is less than 2^63 */
+    const int64_t num_shifted = shift >= 0 ? num * (int64_t(1) << shift) : RoundShift(num, -shift);
+    return RoundShift(num_shifted * (reciprocal >> 2), 59 - CameraModelFixedPoint::kQ);
+}
+
+template <typename Scalar>
+bool CameraModelFixedPoint::Create(const CameraModelT<Scalar, PinholeProjection>& camera, int32_t ground_plane_map_subsample)
+{
+    typedef CameraModelT<Scalar, PinholeProjection> Camera;
+    if (camera.GetLineReadoutTime() > 0) {
+        printf("[CameraModelFixedPoint::Create] Rolling shutter is not supported\n");
+        return false;
+    }
+    width_ = camera.GetWidth();
+    height_ = camera.GetHeight();
+
+    Quaternion q;
+    typename Camera::Vec3 T;
+    camera.GetPose(q, T);
+    const cv::Matx33d R = q.ToRotationMatrix();
+    for (int32_t i = 0; i < 9; i++) R_[i] = static_cast<int32_t>(std::lround(R.val[i] * (int64_t(1) << kQR)));
+    for (int32_t i = 0; i < 3; i++) t_[i] = ToFixed(camera.GetTvec()[i]);
+
+    fx_ = ToFixed(camera.fx());
+    fy_ = ToFixed(camera.fy());
+    cx_ = ToFixed(camera.cx());
+    cy_ = ToFixed(camera.cy());
+    /* Coefficients of high order terms need more precision than Q16 (k3 is multiplied by r^6) */
+    k1_ = std::llround(camera.GetDistCoeff()[0] * (int64_t(1) << kQR));
+    k2_ = std::llround(camera.GetDistCoeff()[1] * (int64_t(1) << kQR));
+    p1_ = std::llround(camera.GetDistCoeff()[2] * (int64_t(1) << kQR));
+    p2_ = std::llround(camera.GetDistCoeff()[3] * (int64_t(1) << kQR));
+    k3_ = std::llround(camera.GetDistCoeff()[4] * (int64_t(1) << kQR));
+    has_distortion_ = k1_ != 0 || k2_ != 0 || p1_ != 0 || p2_ != 0 || k3_ != 0;
+
+    /*** Ground plane map: generated by CameraModel in float, then converted into Q16 ***/
+    ground_plane_map_.clear();
+    ground_plane_map_subsample_ = ground_plane_map_subsample;
+    ground_plane_map_width_ = 0;
+    ground_plane_map_weight_shift_ = -1;
+    if (ground_plane_map_subsample <= 0) return true;
+    for (int32_t shift = 0; shift < 16; shift++) {
+        if ((1 << shift) == ground_plane_map_subsample) ground_plane_map_weight_shift_ = shift * 2;
+    }
+
+    Camera camera_for_map = camera;     /* don't modify the map setting of the original camera */
+    camera_for_map.EnableGroundPlaneMap(ground_plane_map_subsample);
+    const cv::Mat& map = camera_for_map.GetGroundPlaneMap();
+    ground_plane_map_width_ = map.cols;
+    ground_plane_map_.resize(map.rows * map.cols * 3);
+    const double limit = static_cast<double>(kMaxWorld);
+    for (int32_t y = 0; y < map.rows; y++) {
+        for (int32_t x = 0; x < map.cols; x++) {
+            const cv::Vec<Scalar, 3>& element = map.at<cv::Vec<Scalar, 3>>(y, x);
+            int32_t* dst = &ground_plane_map_[(y * map.cols + x) * 3];
+            dst[0] = ToFixed((std::max)(-limit, (std::min)(limit, static_cast<double>(element[0]))));
+            dst[1] = ToFixed((std::max)(-limit, (std::min)(limit, static_cast<double>(element[1]))));
+            dst[2] = element[2] >= Scalar(0.5) ? 1 : 0;
+        }
+    }
+    return true;
+}
+
+void CameraModelFixedPoint::ConvertWorld2Image(const std::vector<cv::Point3i>& object_point_list, std::vector<cv::Point>& image_point_list) const
+{
+    /* The same calculation as CameraModelT::ProjectCameraPoint (PinholeProjection) in Q16 */
+    image_point_list.resize(object_point_list.size());
+    for (int32_t i = 0; i < static_cast<int32_t>(object_point_list.size()); i++) {
+        const int64_t Xw = object_point_list[i].x;
+        const int64_t Yw = object_point_list[i].y;
+        const int64_t Zw = object_point_list[i].z;
+
+        /* Mc = R * Mw + t (Q30 * Q16 -> Q16) */
+        const int64_t Xc = RoundShift(R_[0] * Xw + R_[1] * Yw + R_[2] * Zw, kQR) + t_[0];
+        const int64_t Yc = RoundShift(R_[3] * Xw + R_[4] * Yw + R_[5] * Zw, kQR) + t_[1];
+        const int64_t Zc = RoundShift(R_[6] * Xw + R_[7] * Yw + R_[8] * Zw, kQR) + t_[2];
+        if (Zc <= 0 || std::abs(Xc) > kNormalizedLimit * Zc || std::abs(Yc) > kNormalizedLimit * Zc) {
+            image_point_list[i] = cv::Point(-1, -1);
+            continue;
+        }
+
+        /* Normalize (Q16) */
+        int32_t shift;
+        const uint32_t reciprocal = Reciprocal(Zc, shift);
+        int64_t x = MultiplyReciprocal(Xc, reciprocal, shift);
+        int64_t y = MultiplyReciprocal(Yc, reciprocal, shift);
+
+        if (has_distortion_) {
+            /*** Distort ***/
+            const int64_t rr2 = (std::min)(RoundShift(x * x + y * y, kQ), kRR2Limit);
+            const int64_t rr4 = RoundShift(rr2 * rr2, kQ);
+            const int64_t rr6 = RoundShift(rr4 * rr2, kQ);
+            const int64_t a1 = RoundShift(2 * x * y, kQ);
+            const int64_t a2 = rr2 + RoundShift(2 * x * x, kQ);
+            const int64_t a3 = rr2 + RoundShift(2 * y * y, kQ);
+            const int64_t cdist = kOne + RoundShift(k1_ * rr2 + k2_ * rr4 + k3_ * rr6, kQR);
+            const int64_t xd = RoundShift(x * cdist, kQ) + RoundShift(p1_ * a1 + p2_ * a2, kQR);
+            const int64_t yd = RoundShift(y * cdist, kQ) + RoundShift(p1_ * a3 + p2_ * a1, kQR);
+            x = (std::max)(-kDistortedLimit, (std::min)(kDistortedLimit, xd));
+            y = (std::max)(-kDistortedLimit, (std::min)(kDistortedLimit, yd));
+        }
+
+        const int64_t u = RoundShift(fx_ * x, kQ) + cx_;
+        const int64_t v = RoundShift(fy_ * y, kQ) + cy_;
+        image_point_list[i] = cv::Point(static_cast<int32_t>(RoundShift(u, kQ)), static_cast<int32_t>(RoundShift(v, kQ)));
+    }
+}
+
+void CameraModelFixedPoint::ConvertImage2GroundPlane(const std::vector<cv::Point>& image_point_list, std::vector<cv::Point3i>& object_point_list, std::vector<uint8_t>& is_valid_list) const
+{
+    object_point_list.assign(image_point_list.size(), cv::Point3i(0, 0, 0));
+    is_valid_list.assign(image_point_list.size(), 0);
+    if (ground_plane_map_.empty()) {
+        printf("[CameraModelFixedPoint::ConvertImage2GroundPlane] Ground plane map is not created\n");
+        return;
+    }
+
+    /* Bilinear interpolation with integer weights (0 - subsample) */
+    const int64_t subsample = ground_plane_map_subsample_;
+    const int64_t weight_sum = subsample * subsample;
+    for (int32_t i = 0; i < static_cast<int32_t>(image_point_list.size()); i++) {
+        const cv::Point& image_point = image_point_list[i];
+        if (image_point.x < 0 || image_point.y < 0 || image_point.x >= width_ || image_point.y >= height_) continue;
+        const int32_t ix = image_point.x / ground_plane_map_subsample_;
+        const int32_t iy = image_point.y / ground_plane_map_subsample_;
+        const int64_t ax = image_point.x - ix * subsample;
+        const int64_t ay = image_point.y - iy * subsample;
+        const int64_t w00 = (subsample - ax) * (subsample - ay);
+        const int64_t w01 = ax * (subsample - ay);
+        const int64_t w10 = (subsample - ax) * ay;
+        const int64_t w11 = ax * ay;
+        const int32_t* p0 = &ground_plane_map_[(iy * ground_plane_map_width_ + ix) * 3];
+        const int32_t* p1 = p0 + ground_plane_map_width_ * 3;
+        if (p0[2] == 0 || p0[5] == 0 || p1[2] == 0 || p1[5] == 0) continue;    /* the cell crosses the horizon */
+        int64_t v[2];
+        for (int32_t k = 0; k < 2; k++) {
+            v[k] = p0[k] * w00 + p0[3 + k] * w01 + p1[k] * w10 + p1[3 + k] * w11;
+        }
+        if (ground_plane_map_weight_shift_ > 0) {
+            object_point_list[i] = cv::Point3i(static_cast<int32_t>(RoundShift(v[0], ground_plane_map_weight_shift_)), 0, static_cast<int32_t>(RoundShift(v[1], ground_plane_map_weight_shift_)));
+        } else {
+            object_point_list[i] = cv::Point3i(static_cast<int32_t>(RoundDiv(v[0], weight_sum)), 0, static_cast<int32_t>(RoundDiv(v[1], weight_sum)));
+        }
+        is_valid_list[i] = 1;
+    }
+}
+
+
+/*** Explicit instantiation ***/
+/* Must be after all the definitions */
+template bool CameraModelFixedPoint::Create(const CameraModelT<float, PinholeProjection>&, int32_t);
+template bool CameraModelFixedPoint::Create(const CameraModelT<double, PinholeProjection>&, int32_t);
@@ -0,0 +1,95 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CAMERA_MODEL_FIXED_POINT_
+#define CAMERA_MODEL_FIXED_POINT_
+
+/*** Include ***/
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+/***
+* Fixed-point version of CameraModel (PinholeProjection) for targets without a fast FPU
+*   Parameters are converted from a CameraModel once (Create), and conversion uses integer arithmetic only (int32 / int64)
+*   World coordinate: Q16 (int32, value * 65536). |value| < 16384 (e.g. [m])
+*   Image coordinate: integer pixel (rounded). (-1, -1) for points behind the camera, or outside of |Xc / Zc|, |Yc / Zc| <= 8
+*   Rolling shutter and UnifiedProjection are not supported (Create fails for a camera with rolling shutter)
+*   Division: 1 / Zc is a Q30 reciprocal by Newton-Raphson (multiplications only), because int64 division is a library call on 32-bit CPUs
+*     On x86-64 (hardware division) this is slower than int64 division: 18 [ms] vs 8 [ms] for x and y of 1M points
+*
+* Error versus the float path (CameraModelD::ConvertWorld2Image for the same Q16 input, before rounding to integer pixel):
+*   R, k1, k2, p1, p2, k3 are Q30 and the other parameters are Q16, and each operation is rounded
+*   x = Xc / Zc by the reciprocal is within 0.502 LSB of the exact value (0.5 LSB for rounded division)
+*   |error| <= fx * 2^-16 * (2 + D * (1 + |x|) / Zc) [px]
+*     x: normalized image coordinate (Xc / Zc), Zc: depth in the world unit (>= 1)
+*     D: slope of lens distortion (|d(xd) / d(x)|. 1 without distortion, 1 - 2 for typical lenses inside the image)
+*   e.g. fx = 500, Zc >= 1, |x| <= 2, D <= 2: |error| <= 0.06 [px] (measured: 0.015 [px] for dist = (-0.1, 0.01, -0.005, -0.001, 0))
+*   Rounding to integer pixel adds 0.5 [px]. r^2 is clamped to 16 for lens distortion (far outside the image for typical lenses)
+* ConvertImage2GroundPlane uses the ground plane map of CameraModel converted into Q16 (bilinear interpolation with integer weights)
+*   The map is generated with the undistortion criteria (SetUndistortionCriteria) of the camera
+*   The interpolation is divided by shift if ground_plane_map_subsample is a power of 2 (e.g. 4)
+*   Error versus the interpolation of CameraModel::ConvertImage2GroundPlaneByMap is 2^-16 (rounding). |Xw|, |Zw| are clamped to 16383
+*   Points in cells which have a grid point above the horizon are invalid (CameraModel calculates them without the map)
+*   Near the horizon, the interpolation error of the distance is (r - 1)^2 / (4 * r) (r: ratio of the distance in the cell. see CameraModel::EnableGroundPlaneMap)
+***/
+class CameraModelFixedPoint {
+public:
+    static constexpr int32_t kQ = 16;
+    static constexpr int32_t kOne = 1 << kQ;
+    static constexpr int32_t kMaxWorld = 16383;     /* max abs of world coordinate */
+
+    static int32_t ToFixed(double value) { return static_cast<int32_t>(std::lround(value * kOne)); }
+    static double ToDouble(int32_t value) { return static_cast<double>(value) / kOne; }
+
+public:
+    /***
+    * Convert parameters of the camera. ground_plane_map_subsample: the same as CameraModel::EnableGroundPlaneMap (0 = no ground plane map)
+    *   return false if the camera uses rolling shutter
+    ***/
+    template <typename Scalar>
+    bool Create(const CameraModelT<Scalar, PinholeProjection>& camera, int32_t ground_plane_map_subsample = 4);
+
+    /* Mw (Q16) -> Image (integer pixel) */
+    void ConvertWorld2Image(const std::vector<cv::Point3i>& object_point_list, std::vector<cv::Point>& image_point_list) const;
+
+    /***
+    * Image (integer pixel) -> Mw (Q16) on the ground plane (Yw = 0)
+    *   is_valid_list: 0 for points outside the image and in cells crossing the horizon
+    ***/
+    void ConvertImage2GroundPlane(const std::vector<cv::Point>& image_point_list, std::vector<cv::Point3i>& object_point_list, std::vector<uint8_t>& is_valid_list) const;
+
+private:
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+
+    /* Mc = R * Mw + t */
+    int32_t R_[9] = { 0 };     /* Q30 */
+    int64_t t_[3] = { 0 };     /* Q16 */
+    int64_t fx_ = 0, fy_ = 0, cx_ = 0, cy_ = 0;        /* Q16 */
+    int64_t k1_ = 0, k2_ = 0, p1_ = 0, p2_ = 0, k3_ = 0;   /* Q30 */
+    bool has_distortion_ = false;
+
+    /* (Xw, Zw, is_valid) for every subsample pixels. Xw, Zw: Q16, is_valid: 0 or 1 */
+    std::vector<int32_t> ground_plane_map_;
+    int32_t ground_plane_map_subsample_ = 0;
+    int32_t ground_plane_map_width_ = 0;
+    int32_t ground_plane_map_weight_shift_ = -1;    /* log2(subsample^2), -1 if subsample is not a power of 2 */
+};
+
+#endif
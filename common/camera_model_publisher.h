@@ -0,0 +1,135 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CAMERA_MODEL_PUBLISHER_
+#define CAMERA_MODEL_PUBLISHER_
+
+/*** Include ***/
+#include <cstdint>
+#include <memory>
+#include <atomic>
+
+#include "camera_model.h"
+
+/***
+* Publish immutable snapshots of a CameraModel to worker threads
+*   Control thread (GUI, key / mouse callbacks): modify its own CameraModel as usual, then call Publish()
+*     The camera is deep copied (CopyTo) into a free slot and its derived parameters are prepared before the slot is made current,
+*     so readers never see a half-updated camera, never update derived parameters, and don't share tables with the control camera
+*     Nothing is copied if the camera has the same parameter version as the current snapshot (GetParameterVersion), so Publish() can be called every frame
+*   Worker threads: Get() a snapshot and use it for a whole frame
+*     A snapshot is const, so only const methods (ConvertWorld2Image, CullPoints, ConvertImage2GroundPlaneDirect, etc.) can be called
+*     The slot is released when the snapshot is destroyed. Snapshots must not outlive the publisher
+*   Lock-free: slots are allocated in the constructor and selected by an atomic index, and each slot has an atomic reader count
+*     Get() never waits (it retries only if Publish() switched the slot at the same time)
+*     Publish() copies into the buffers of the slot, so it allocates only when they grow
+*       (the first Publish() into each slot, a larger image size, or more rows of rolling shutter poses)
+*     (std::atomic_load / atomic_store for shared_ptr are not used because they are implemented with a lock in common standard libraries)
+*   reader_num: max number of snapshots held at the same time. Publish() returns false if no slot is free (call it again later)
+*   Publish() must be called from one thread
+***/
+template <typename Scalar, typename Projection = PinholeProjection>
+class CameraModelPublisherT {
+public:
+    typedef CameraModelT<Scalar, Projection> Camera;
+
+private:
+    struct Slot {
+        Camera camera;
+        std::atomic<int32_t> reader_cnt{ 0 };
+    };
+
+public:
+    class Snapshot {
+    public:
+        Snapshot() {}
+        Snapshot(Snapshot&& other) : slot_(other.slot_) { other.slot_ = nullptr; }
+        Snapshot& operator=(Snapshot&& other)
+        {
+            if (this != &other) {
+                Release();
+                slot_ = other.slot_;
+                other.slot_ = nullptr;
+            }
+            return *this;
+        }
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        ~Snapshot() { Release(); }
+
+        const Camera& operator*() const { return slot_->camera; }
+        const Camera* operator->() const { return &slot_->camera; }
+
+    private:
+        friend class CameraModelPublisherT;
+        explicit Snapshot(Slot* slot) : slot_(slot) {}
+        void Release()
+        {
+            if (slot_) slot_->reader_cnt--;
+            slot_ = nullptr;
+        }
+
+    private:
+        Slot* slot_ = nullptr;
+    };
+
+public:
+    explicit CameraModelPublisherT(int32_t reader_num = 1) : slot_num_(reader_num + 2), slot_list_(new Slot[reader_num + 2])
+    {
+        /* the current one, one for each reader (holding an old one), and one to write */
+        slot_list_[0].camera.Prepare();
+    }
+    CameraModelPublisherT(const CameraModelPublisherT&) = delete;
+    CameraModelPublisherT& operator=(const CameraModelPublisherT&) = delete;
+
+    bool Publish(const Camera& camera)
+    {
+        const int32_t current_index = current_index_;
+        if (slot_list_[current_index].camera.GetParameterVersion() == camera.GetParameterVersion()) return true;
+        for (int32_t i = 0; i < slot_num_; i++) {
+            /***
+            * A reader which read the index of this slot before it became free increments reader_cnt after this check,
+            * but it sees that the slot is not current and releases it without reading the camera
+            ***/
+            if (i == current_index || slot_list_[i].reader_cnt != 0) continue;
+            camera.CopyTo(slot_list_[i].camera);
+            slot_list_[i].camera.Prepare();
+            current_index_ = i;
+            return true;
+        }
+        return false;
+    }
+
+    Snapshot Get()
+    {
+        while (true) {
+            const int32_t index = current_index_;
+            Slot& slot = slot_list_[index];
+            slot.reader_cnt++;
+            if (current_index_ == index) return Snapshot(&slot);
+            slot.reader_cnt--;      /* switched by Publish() at the same time */
+        }
+    }
+
+private:
+    /* reader_cnt and current_index_ use the default (sequentially consistent) order: Get() writes reader_cnt then reads current_index_, and Publish() does the opposite */
+    const int32_t slot_num_;
+    std::unique_ptr<Slot[]> slot_list_;
+    std::atomic<int32_t> current_index_{ 0 };
+};
+
+typedef CameraModelPublisherT<float> CameraModelPublisher;
+typedef CameraModelPublisherT<double> CameraModelPublisherD;
+
+#endif
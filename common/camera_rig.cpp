@@ -0,0 +1,221 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+#include "camera_rig.h"
+
+/*** Macro ***/
+/* The number of points processed at once. Input (12 Byte x 1024 for float) stays in L1/L2 cache while all cameras read it */
+static constexpr int32_t kBlockSize = 1024;
+
+
+/*** Function ***/
+template <typename Scalar, typename Projection>
+void CameraRigT<Scalar, Projection>::ConvertWorld2Image(const std::vector<Point3>& object_point_list, std::vector<std::vector<Point2>>& image_point_list, std::vector<std::vector<uint8_t>>& is_visible_list, std::vector<std::vector<Scalar>>* depth_list)
+{
+    const int32_t camera_num = GetCameraNum();
+    const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+    image_point_list.resize(camera_num);
+    is_visible_list.resize(camera_num);
+    if (depth_list) depth_list->resize(camera_num);
+    for (int32_t c = 0; c < camera_num; c++) {
+        camera_list_[c]->Prepare();     /* derived parameters must be ready before entering the parallel region */
+        image_point_list[c].resize(point_num);
+        is_visible_list[c].resize(point_num);
+        if (depth_list) (*depth_list)[c].resize(point_num);
+    }
+    if (point_num == 0) return;
+
+    const int32_t block_num = (point_num + kBlockSize - 1) / kBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t block = 0; block < block_num; block++) {
+        const int32_t offset = block * kBlockSize;
+        const int32_t size = (std::min)(kBlockSize, point_num - offset);
+        const Point3* src = object_point_list.data() + offset;
+        for (int32_t c = 0; c < camera_num; c++) {
+            Camera& camera = *camera_list_[c];
+            Point2* dst = image_point_list[c].data() + offset;
+            Scalar* depth = depth_list ? (*depth_list)[c].data() + offset : nullptr;
+            camera.ConvertWorld2ImageBlock(src, size, dst, depth);
+
+            /* Points behind the camera are (-1, -1), so they are also invisible */
+            const Scalar width = static_cast<Scalar>(camera.GetWidth());
+            const Scalar height = static_cast<Scalar>(camera.GetHeight());
+            uint8_t* is_visible = is_visible_list[c].data() + offset;
+            for (int32_t i = 0; i < size; i++) {
+                is_visible[i] = (dst[i].x >= 0 && dst[i].y >= 0 && dst[i].x < width && dst[i].y < height) ? 1 : 0;
+            }
+        }
+    }
+}
+
+template <typename Scalar, typename Projection>
+void CameraRigT<Scalar, Projection>::Triangulate(const std::vector<std::vector<Point2>>& image_point_list, std::vector<Point3>& object_point_list, std::vector<uint8_t>& is_valid_list,
+    std::vector<Scalar>* error_list, int32_t refine_iteration)
+{
+    const int32_t camera_num = GetCameraNum();
+    const int32_t point_num = image_point_list.empty() ? 0 : static_cast<int32_t>(image_point_list[0].size());
+    object_point_list.assign(point_num, Point3(0, 0, 0));
+    is_valid_list.assign(point_num, 0);
+    if (error_list) error_list->assign(point_num, Scalar(-1));
+    if (point_num == 0) return;
+    if (camera_num < 2 || image_point_list.size() != camera_num) {
+        printf("[Triangulate] Invalid camera num (%d, %d)\n", camera_num, static_cast<int32_t>(image_point_list.size()));
+        return;
+    }
+    for (const auto& image_point_list_of_camera : image_point_list) {
+        if (image_point_list_of_camera.size() != point_num) {
+            printf("[Triangulate] Invalid point num\n");
+            return;
+        }
+    }
+
+    /*** Undistorted rays (Mc = Zc * ray) and poses of all cameras ***/
+    std::vector<std::vector<Point3>> ray_list(camera_num);
+    std::vector<cv::Matx33d> R_list(camera_num);
+    std::vector<cv::Vec3d> t_list(camera_num);
+    const std::vector<Scalar> one_list(point_num, Scalar(1));
+    for (int32_t c = 0; c < camera_num; c++) {
+        Camera& camera = *camera_list_[c];
+        camera.ConvertImage2Camera(image_point_list[c], one_list, ray_list[c]);
+        Quaternion q;
+        typename Camera::Vec3 T;
+        camera.GetPose(q, T);
+        R_list[c] = q.ToRotationMatrix();
+        t_list[c] = -(R_list[c] * cv::Vec3d(T[0], T[1], T[2]));     /* t = -RT */
+    }
+
+    /*** Linear triangulation ***/
+    /* Mc = R * Mw + t is parallel to (x, y, 1):  (x * r3 - r1) . Mw = t1 - x * t3,  (y * r3 - r2) . Mw = t2 - y * t3  (ri = i-th row of R) */
+    /* Equations of all observations are solved by least squares (normal equations) */
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < point_num; i++) {
+        cv::Matx33d A = cv::Matx33d::zeros();
+        cv::Vec3d b(0, 0, 0);
+        int32_t observed_num = 0;
+        for (int32_t c = 0; c < camera_num; c++) {
+            const Point2& image_point = image_point_list[c][i];
+            const Point3& ray = ray_list[c][i];
+            if (image_point.x < 0 || image_point.y < 0 || std::isnan(ray.x)) continue;
+            const cv::Matx33d& R = R_list[c];
+            const cv::Vec3d& t = t_list[c];
+            for (int32_t k = 0; k < 2; k++) {
+                const double m = k == 0 ? ray.x : ray.y;
+                const cv::Vec3d a(m * R(2, 0) - R(k, 0), m * R(2, 1) - R(k, 1), m * R(2, 2) - R(k, 2));
+                const double rhs = t[k] - m * t[2];
+                A += a * a.t();
+                b += a * rhs;
+            }
+            observed_num++;
+        }
+        if (observed_num < 2) continue;
+        cv::Vec3d M;
+        if (!cv::solve(A, b, M, cv::DECOMP_CHOLESKY)) continue;    /* parallel rays */
+        object_point_list[i] = Point3(static_cast<Scalar>(M[0]), static_cast<Scalar>(M[1]), static_cast<Scalar>(M[2]));
+        is_valid_list[i] = 1;
+    }
+
+    /*** Gauss-Newton on reprojection error ***/
+    /* Jacobians of all points are calculated by each camera in one pass, and the 3 x 3 normal equations are accumulated for each point */
+    std::vector<cv::Matx33d> JtJ_list(point_num);
+    std::vector<cv::Vec3d> Jtr_list(point_num);
+    std::vector<Point2> projected_point_list;
+    std::vector<typename Camera::Matx26> jacobian_pose_list;
+    std::vector<typename Camera::Matx23> jacobian_point_list;
+    for (int32_t iteration = 0; iteration < refine_iteration; iteration++) {
+        std::fill(JtJ_list.begin(), JtJ_list.end(), cv::Matx33d::zeros());
+        std::fill(Jtr_list.begin(), Jtr_list.end(), cv::Vec3d(0, 0, 0));
+        for (int32_t c = 0; c < camera_num; c++) {
+            camera_list_[c]->ConvertWorld2ImageJacobian(object_point_list, projected_point_list, jacobian_pose_list, jacobian_point_list);
+            const std::vector<Point2>& observed_point_list = image_point_list[c];
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int32_t i = 0; i < point_num; i++) {
+                const Point2& observed_point = observed_point_list[i];
+                const Point2& projected_point = projected_point_list[i];
+                if (!is_valid_list[i] || observed_point.x < 0 || observed_point.y < 0) continue;
+                if (projected_point.x == -1 && projected_point.y == -1) continue;     /* behind the camera */
+                const cv::Matx23d J = jacobian_point_list[i];
+                const cv::Vec2d r(projected_point.x - observed_point.x, projected_point.y - observed_point.y);
+                JtJ_list[i] += J.t() * J;
+                Jtr_list[i] += J.t() * r;
+            }
+        }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t i = 0; i < point_num; i++) {
+            if (!is_valid_list[i]) continue;
+            cv::Vec3d delta;
+            if (!cv::solve(JtJ_list[i], Jtr_list[i], delta, cv::DECOMP_CHOLESKY)) continue;
+            Point3& object_point = object_point_list[i];
+            object_point.x -= static_cast<Scalar>(delta[0]);
+            object_point.y -= static_cast<Scalar>(delta[1]);
+            object_point.z -= static_cast<Scalar>(delta[2]);
+        }
+    }
+
+    /*** Check the result: in front of all cameras which observe the point, and reprojection error ***/
+    /* "In front" is the test of the projection model (reprojected to (-1, -1) otherwise), not Zc > 0: UnifiedProjection with xi > 0 sees points of Zc < 0 */
+    std::vector<std::vector<Point2>> reprojected_point_list;
+    std::vector<std::vector<uint8_t>> is_visible_list;
+    ConvertWorld2Image(object_point_list, reprojected_point_list, is_visible_list);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < point_num; i++) {
+        if (!is_valid_list[i]) continue;
+        double error2 = 0;
+        int32_t observed_num = 0;
+        for (int32_t c = 0; c < camera_num; c++) {
+            const Point2& observed_point = image_point_list[c][i];
+            if (observed_point.x < 0 || observed_point.y < 0) continue;
+            const Point2& reprojected_point = reprojected_point_list[c][i];
+            if (reprojected_point.x == -1 && reprojected_point.y == -1) {
+                is_valid_list[i] = 0;
+                break;
+            }
+            const double dx = reprojected_point.x - observed_point.x;
+            const double dy = reprojected_point.y - observed_point.y;
+            error2 += dx * dx + dy * dy;
+            observed_num++;
+        }
+        if (is_valid_list[i] && error_list) (*error_list)[i] = static_cast<Scalar>(std::sqrt(error2 / observed_num));
+    }
+}
+
+
+/*** Explicit instantiation ***/
+/* Must be after all the definitions */
+template class CameraRigT<float, PinholeProjection>;
+template class CameraRigT<double, PinholeProjection>;
+template class CameraRigT<float, UnifiedProjection>;
+template class CameraRigT<double, UnifiedProjection>;
@@ -0,0 +1,75 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CAMERA_RIG_
+#define CAMERA_RIG_
+
+/*** Include ***/
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+/***
+* Set of cameras which see the same points (e.g. surround view cameras, real camera + virtual camera)
+*   Points are projected into all cameras in one traversal: a block of points is read once and projected by all cameras while it's in cache
+*   Cameras are not owned by the rig. Parameters of each camera can be modified via the camera as usual
+***/
+template <typename Scalar, typename Projection = PinholeProjection>
+class CameraRigT {
+public:
+    typedef CameraModelT<Scalar, Projection> Camera;
+    typedef typename Camera::Point2 Point2;
+    typedef typename Camera::Point3 Point3;
+
+public:
+    void AddCamera(Camera* camera) { camera_list_.push_back(camera); }
+    void Clear() { camera_list_.clear(); }
+    int32_t GetCameraNum() const { return static_cast<int32_t>(camera_list_.size()); }
+    Camera& GetCamera(int32_t index) { return *camera_list_[index]; }
+
+    /***
+    * Mw -> Image for all cameras
+    *   image_point_list[camera_index][point_index]: the same as CameraModel::ConvertWorld2Image
+    *   is_visible_list[camera_index][point_index]: 1 if the point is in front of the camera and inside the image, otherwise 0
+    *   depth_list[camera_index][point_index]: Zc (optional. e.g. to sort points)
+    ***/
+    void ConvertWorld2Image(const std::vector<Point3>& object_point_list, std::vector<std::vector<Point2>>& image_point_list, std::vector<std::vector<uint8_t>>& is_visible_list, std::vector<std::vector<Scalar>>* depth_list = nullptr);
+
+    /***
+    * Image points matched among cameras -> Mw (triangulation)
+    *   image_point_list[camera_index][point_index]: the same size for all cameras. Negative value (e.g. (-1, -1)) = not observed by the camera
+    *   object_point_list[point_index]: linear triangulation on undistorted rays, then refined by Gauss-Newton on reprojection error (refine_iteration times)
+    *   is_valid_list[point_index]: 1 if the point is observed by 2 or more cameras and in front of all of them (the same test as ConvertWorld2Image, so Zc < 0 is valid for UnifiedProjection with xi > 0)
+    *   error_list[point_index]: RMS reprojection error [px] (optional. -1 for invalid points)
+    ***/
+    void Triangulate(const std::vector<std::vector<Point2>>& image_point_list, std::vector<Point3>& object_point_list, std::vector<uint8_t>& is_valid_list,
+        std::vector<Scalar>* error_list = nullptr, int32_t refine_iteration = 3);
+
+private:
+    std::vector<Camera*> camera_list_;
+};
+
+/* Instantiated in camera_rig.cpp */
+extern template class CameraRigT<float, PinholeProjection>;
+extern template class CameraRigT<double, PinholeProjection>;
+extern template class CameraRigT<float, UnifiedProjection>;
+extern template class CameraRigT<double, UnifiedProjection>;
+
+typedef CameraRigT<float> CameraRig;
+typedef CameraRigT<double> CameraRigD;
+
+#endif
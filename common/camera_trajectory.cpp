@@ -0,0 +1,88 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "quaternion.h"
+#include "camera_trajectory.h"
+
+/*** Function ***/
+bool CameraTrajectory::AddPose(double timestamp, const Quaternion& q, const cv::Vec3d& T)
+{
+    if (!pose_list_.empty() && timestamp <= pose_list_.back().timestamp) {
+        printf("[CameraTrajectory::AddPose] timestamp must be in ascending order: %f <= %f\n", timestamp, pose_list_.back().timestamp);
+        return false;
+    }
+    Pose pose;
+    pose.timestamp = timestamp;
+    pose.q = q.Normalized();
+    pose.T = T;
+    pose_list_.push_back(pose);
+    return true;
+}
+
+bool CameraTrajectory::GetPose(double timestamp, Quaternion& q, cv::Vec3d& T) const
+{
+    if (pose_list_.empty()) return false;
+    Interpolate(timestamp, q, T);
+    return true;
+}
+
+bool CameraTrajectory::GetPose(const std::vector<double>& timestamp_list, std::vector<Quaternion>& q_list, std::vector<cv::Vec3d>& T_list) const
+{
+    if (pose_list_.empty()) return false;
+    const int32_t num = static_cast<int32_t>(timestamp_list.size());
+    q_list.resize(num);
+    T_list.resize(num);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        Interpolate(timestamp_list[i], q_list[i], T_list[i]);
+    }
+    return true;
+}
+
+void CameraTrajectory::Interpolate(double timestamp, Quaternion& q, cv::Vec3d& T) const
+{
+    /* Find the first pose after the timestamp */
+    const auto it = std::upper_bound(pose_list_.begin(), pose_list_.end(), timestamp, [](double t, const Pose& pose) {
+        return t < pose.timestamp;
+    });
+    if (it == pose_list_.begin()) {
+        q = pose_list_.front().q;
+        T = pose_list_.front().T;
+        return;
+    }
+    if (it == pose_list_.end()) {
+        q = pose_list_.back().q;
+        T = pose_list_.back().T;
+        return;
+    }
+
+    const Pose& pose0 = *(it - 1);
+    const Pose& pose1 = *it;
+    const double ratio = (timestamp - pose0.timestamp) / (pose1.timestamp - pose0.timestamp);
+    q = Quaternion::Slerp(pose0.q, pose1.q, ratio);
+    T = pose0.T * (1 - ratio) + pose1.T * ratio;
+}
@@ -0,0 +1,74 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CAMERA_TRAJECTORY_
+#define CAMERA_TRAJECTORY_
+
+/*** Include ***/
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "quaternion.h"
+#include "camera_model.h"
+
+/***
+* Timestamped camera poses (e.g. a logged vehicle trajectory)
+*   Pose = (q, T) which is the same as CameraModelT::SetPose
+*     q: rotation from world coordinate to camera coordinate
+*     T: camera position in world coordinate (Oc - Ow)
+*   The pose at any timestamp is interpolated from the two neighboring poses (rotation: SLERP, position: linear)
+*   Timestamps out of the range are clamped to the first / last pose
+***/
+class CameraTrajectory {
+public:
+    struct Pose {
+        double timestamp;   /* [sec] */
+        Quaternion q;
+        cv::Vec3d T;
+    };
+
+public:
+    /* Poses must be added in ascending order of timestamp. return false if not */
+    bool AddPose(double timestamp, const Quaternion& q, const cv::Vec3d& T);
+    void Clear() { pose_list_.clear(); }
+    int32_t GetPoseNum() const { return static_cast<int32_t>(pose_list_.size()); }
+    const std::vector<Pose>& GetPoseList() const { return pose_list_; }
+
+    /* return false if no pose is added */
+    bool GetPose(double timestamp, Quaternion& q, cv::Vec3d& T) const;
+
+    /* Batched query. timestamp_list doesn't need to be sorted */
+    bool GetPose(const std::vector<double>& timestamp_list, std::vector<Quaternion>& q_list, std::vector<cv::Vec3d>& T_list) const;
+
+    /* Set the pose at the timestamp to the camera (CameraModelT) */
+    template <typename Scalar, typename Projection>
+    bool ApplyPose(double timestamp, CameraModelT<Scalar, Projection>& camera) const
+    {
+        Quaternion q;
+        cv::Vec3d T;
+        if (!GetPose(timestamp, q, T)) return false;
+        camera.SetPose(q, cv::Vec<Scalar, 3>(static_cast<Scalar>(T[0]), static_cast<Scalar>(T[1]), static_cast<Scalar>(T[2])));
+        return true;
+    }
+
+private:
+    void Interpolate(double timestamp, Quaternion& q, cv::Vec3d& T) const;
+
+private:
+    std::vector<Pose> pose_list_;
+};
+
+#endif
@@ -24,9 +24,21 @@ limitations under the License.
 #include <algorithm>
 #include <chrono>
 
+/* for thread affinity */
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 /* for OpenCV */
 #include <opencv2/opencv.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 //#include "common_helper.h"
 #include "common_helper_cv.h"
 
@@ -111,6 +123,76 @@ void CommonHelper::CropResizeCvt(const cv::Mat& org, cv::Mat& dst, int32_t& crop
 
 }
 
+bool CommonHelper::CreateBlobFromImage(const cv::Mat& image, cv::Mat& blob, int32_t batch_index, bool swap_rb, float scale, const std::array<float, 3>& mean_list, const std::array<float, 3>& norm_list)
+{
+    if (image.empty() || image.type() != CV_8UC3) {
+        printf("[CreateBlobFromImage] Invalid image type\n");
+        return false;
+    }
+    if (blob.dims != 4 || blob.type() != CV_32F || blob.size[1] != 3 || !blob.isContinuous() || batch_index < 0 || batch_index >= blob.size[0]) {
+        printf("[CreateBlobFromImage] Invalid blob\n");
+        return false;
+    }
+    const int32_t dst_h = blob.size[2];
+    const int32_t dst_w = blob.size[3];
+    const int32_t plane_size = dst_h * dst_w;
+    float* dst = blob.ptr<float>() + static_cast<size_t>(batch_index) * 3 * plane_size;
+
+    /* blob[c] = pixel[src_c] * alpha[c] + beta[c] */
+    std::array<int32_t, 3> src_channel_list = { 0, 1, 2 };
+    if (swap_rb) src_channel_list = { 2, 1, 0 };
+    std::array<float, 3> alpha, beta;
+    for (int32_t c = 0; c < 3; c++) {
+        alpha[c] = scale / norm_list[c];
+        beta[c] = -mean_list[c] / norm_list[c];
+    }
+
+    /* Source position for each column (pixel center alignment, clamped at the border) */
+    const float scale_x = static_cast<float>(image.cols) / dst_w;
+    const float scale_y = static_cast<float>(image.rows) / dst_h;
+    std::vector<int32_t> x0_list(dst_w), x1_list(dst_w);
+    std::vector<float> wx_list(dst_w);
+    for (int32_t x = 0; x < dst_w; x++) {
+        float sx = (x + 0.5f) * scale_x - 0.5f;
+        int32_t x0 = static_cast<int32_t>(std::floor(sx));
+        float wx = sx - x0;
+        if (x0 < 0) { x0 = 0; wx = 0.0f; }
+        if (x0 >= image.cols - 1) { x0 = image.cols - 1; wx = 0.0f; }
+        x0_list[x] = x0 * 3;
+        x1_list[x] = (std::min)(x0 + 1, image.cols - 1) * 3;
+        wx_list[x] = wx;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < dst_h; y++) {
+        float sy = (y + 0.5f) * scale_y - 0.5f;
+        int32_t y0 = static_cast<int32_t>(std::floor(sy));
+        float wy = sy - y0;
+        if (y0 < 0) { y0 = 0; wy = 0.0f; }
+        if (y0 >= image.rows - 1) { y0 = image.rows - 1; wy = 0.0f; }
+        const uint8_t* src0 = image.ptr<uint8_t>(y0);
+        const uint8_t* src1 = image.ptr<uint8_t>((std::min)(y0 + 1, image.rows - 1));
+
+        float* dst_row[3];
+        for (int32_t c = 0; c < 3; c++) dst_row[c] = dst + c * plane_size + y * dst_w;
+        for (int32_t x = 0; x < dst_w; x++) {
+            const int32_t x0 = x0_list[x];
+            const int32_t x1 = x1_list[x];
+            const float wx = wx_list[x];
+            for (int32_t c = 0; c < 3; c++) {
+                const int32_t sc = src_channel_list[c];
+                const float top = src0[x0 + sc] + (src0[x1 + sc] - src0[x0 + sc]) * wx;
+                const float bottom = src1[x0 + sc] + (src1[x1 + sc] - src1[x0 + sc]) * wx;
+                const float value = top + (bottom - top) * wy;
+                dst_row[c][x] = value * alpha[c] + beta[c];
+            }
+        }
+    }
+    return true;
+}
+
 /* https://github.com/JetsonHacksNano/CSI-Camera/blob/master/simple_camera.cpp */
 /* modified by iwatake2222 */
 std::string CommonHelper::CreateGStreamerPipeline(int capture_width, int capture_height, int display_width, int display_height, int framerate, int flip_method) {
@@ -192,3 +274,18 @@ bool CommonHelper::InputKeyCommand(cv::VideoCapture& cap)
 
     return ret_to_quit;
 }
+
+bool CommonHelper::SetThreadAffinity(int32_t cpu_id)
+{
+    if (cpu_id < 0) return true;
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu_id) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_id, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
@@ -37,10 +37,22 @@ enum {
 cv::Scalar CreateCvColor(int32_t b, int32_t g, int32_t r);
 void DrawText(cv::Mat& mat, const std::string& text, cv::Point pos, double font_scale, int32_t thickness, cv::Scalar color_front, cv::Scalar color_back, bool is_text_on_rect = true);
 void CropResizeCvt(const cv::Mat& org, cv::Mat& dst, int32_t& crop_x, int32_t& crop_y, int32_t& crop_w, int32_t& crop_h, bool is_rgb = true, int32_t crop_type = kCropTypeStretch, bool resize_by_linear = true);
+/***
+* Create an input blob for DNN in one pass (fused version of resize, cvtColor, convertTo, subtract, divide and cv::dnn::blobFromImage)
+*   image: CV_8UC3. Resized to the blob size by bilinear interpolation (the same sampling as cv::resize INTER_LINEAR)
+*   blob: N x 3 x H x W, CV_32F. Allocated by the caller once and reused. The image is written at batch_index
+*   blob[c] = (pixel[c] * scale - mean_list[c]) / norm_list[c]  (c: channel in the blob. pixel channels are swapped if swap_rb)
+*   Rows are processed in parallel by OpenMP
+***/
+bool CreateBlobFromImage(const cv::Mat& image, cv::Mat& blob, int32_t batch_index = 0, bool swap_rb = false, float scale = 1.0f,
+    const std::array<float, 3>& mean_list = { 0.0f, 0.0f, 0.0f }, const std::array<float, 3>& norm_list = { 1.0f, 1.0f, 1.0f });
 std::string CreateGStreamerPipeline(int capture_width, int capture_height, int display_width, int display_height, int framerate, int flip_method);
 bool FindSourceImage(const std::string& input_name, cv::VideoCapture& cap, int32_t width = 640, int32_t height = 480);
 bool InputKeyCommand(cv::VideoCapture& cap);
 
+/* Pin the calling thread to a CPU core (cpu_id < 0: do nothing). Returns false if not supported on the platform */
+bool SetThreadAffinity(int32_t cpu_id);
+
 }
 
 #endif
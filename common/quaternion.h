@@ -0,0 +1,132 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef QUATERNION_
+#define QUATERNION_
+
+/*** Include ***/
+#include <cmath>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+/***
+* Unit quaternion for rotation (Hamilton convention, double)
+*   q = (w, x, y, z) = (cos(theta / 2), sin(theta / 2) * axis)
+*   q1 * q2 = rotation q2, then q1 (the same order as rotation matrices: R1 * R2)
+*   All conversions are closed form (no cv::Rodrigues)
+***/
+struct Quaternion {
+    double w = 1;
+    double x = 0;
+    double y = 0;
+    double z = 0;
+
+    Quaternion() {}
+    Quaternion(double w, double x, double y, double z) : w(w), x(x), y(y), z(z) {}
+
+    /* rvec = theta * axis [rad] (the same as the input of cv::Rodrigues) */
+    static Quaternion FromRotationVector(double rx, double ry, double rz)
+    {
+        const double theta = std::sqrt(rx * rx + ry * ry + rz * rz);
+        if (theta < 1e-12) return Quaternion(1, rx * 0.5, ry * 0.5, rz * 0.5).Normalized();  /* sin(theta / 2) / theta ~= 1 / 2 */
+        const double k = std::sin(theta * 0.5) / theta;
+        return Quaternion(std::cos(theta * 0.5), rx * k, ry * k, rz * k);
+    }
+
+    void ToRotationVector(double& rx, double& ry, double& rz) const
+    {
+        /* Use w >= 0 so that theta is in [0, pi] */
+        const double sign = w < 0 ? -1 : 1;
+        const double norm_v = std::sqrt(x * x + y * y + z * z);
+        const double theta = 2 * std::atan2(norm_v, sign * w);
+        const double k = norm_v < 1e-12 ? 2 * sign : sign * theta / norm_v;
+        rx = x * k;
+        ry = y * k;
+        rz = z * k;
+    }
+
+    static Quaternion FromRotationMatrix(const cv::Matx33d& R)
+    {
+        /* Select the largest component to avoid dividing by a small value */
+        const double trace = R(0, 0) + R(1, 1) + R(2, 2);
+        Quaternion q;
+        if (trace > 0) {
+            const double s = 0.5 / std::sqrt(trace + 1);
+            q = Quaternion(0.25 / s, (R(2, 1) - R(1, 2)) * s, (R(0, 2) - R(2, 0)) * s, (R(1, 0) - R(0, 1)) * s);
+        } else if (R(0, 0) > R(1, 1) && R(0, 0) > R(2, 2)) {
+            const double s = 2 * std::sqrt(1 + R(0, 0) - R(1, 1) - R(2, 2));
+            q = Quaternion((R(2, 1) - R(1, 2)) / s, 0.25 * s, (R(0, 1) + R(1, 0)) / s, (R(0, 2) + R(2, 0)) / s);
+        } else if (R(1, 1) > R(2, 2)) {
+            const double s = 2 * std::sqrt(1 + R(1, 1) - R(0, 0) - R(2, 2));
+            q = Quaternion((R(0, 2) - R(2, 0)) / s, (R(0, 1) + R(1, 0)) / s, 0.25 * s, (R(1, 2) + R(2, 1)) / s);
+        } else {
+            const double s = 2 * std::sqrt(1 + R(2, 2) - R(0, 0) - R(1, 1));
+            q = Quaternion((R(1, 0) - R(0, 1)) / s, (R(0, 2) + R(2, 0)) / s, (R(1, 2) + R(2, 1)) / s, 0.25 * s);
+        }
+        return q.Normalized();
+    }
+
+    cv::Matx33d ToRotationMatrix() const
+    {
+        const double xx = x * x, yy = y * y, zz = z * z;
+        const double xy = x * y, xz = x * z, yz = y * z;
+        const double wx = w * x, wy = w * y, wz = w * z;
+        return cv::Matx33d(
+            1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy),
+            2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx),
+            2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy));
+    }
+
+    Quaternion operator*(const Quaternion& q) const
+    {
+        return Quaternion(
+            w * q.w - x * q.x - y * q.y - z * q.z,
+            w * q.x + x * q.w + y * q.z - z * q.y,
+            w * q.y - x * q.z + y * q.w + z * q.x,
+            w * q.z + x * q.y - y * q.x + z * q.w);
+    }
+
+    Quaternion Conjugate() const { return Quaternion(w, -x, -y, -z); }
+
+    Quaternion Normalized() const
+    {
+        const double norm = std::sqrt(w * w + x * x + y * y + z * z);
+        const double norm_inv = norm > 0 ? 1 / norm : 1;
+        return Quaternion(w * norm_inv, x * norm_inv, y * norm_inv, z * norm_inv);
+    }
+
+    /* Spherical linear interpolation. ratio = 0: q0, ratio = 1: q1 (the shorter path) */
+    static Quaternion Slerp(const Quaternion& q0, const Quaternion& q1, double ratio)
+    {
+        double dot = q0.w * q1.w + q0.x * q1.x + q0.y * q1.y + q0.z * q1.z;
+        const double sign = dot < 0 ? -1 : 1;   /* q and -q are the same rotation */
+        dot *= sign;
+        double k0, k1;
+        if (dot > 0.9995) {
+            /* Almost the same rotation: linear interpolation (sin(theta) ~= 0) */
+            k0 = 1 - ratio;
+            k1 = ratio;
+        } else {
+            const double theta = std::acos((std::min)(dot, 1.0));
+            const double sin_theta_inv = 1 / std::sin(theta);
+            k0 = std::sin((1 - ratio) * theta) * sin_theta_inv;
+            k1 = std::sin(ratio * theta) * sin_theta_inv;
+        }
+        k1 *= sign;
+        return Quaternion(k0 * q0.w + k1 * q1.w, k0 * q0.x + k1 * q1.x, k0 * q0.y + k1 * q1.y, k0 * q0.z + k1 * q1.z).Normalized();
+    }
+};
+
+#endif
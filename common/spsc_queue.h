@@ -0,0 +1,73 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef SPSC_QUEUE_
+#define SPSC_QUEUE_
+
+/*** Include ***/
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <utility>
+
+/***
+* Bounded lock-free queue for one producer thread and one consumer thread
+*   TryPush / TryPop never block and never allocate (slots are allocated in the constructor)
+*   TryPush must be called only from the producer, TryPop only from the consumer
+*   Objects are moved into / out of slots, so image data such as cv::Mat is never copied
+***/
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slot_list_(capacity + 1), head_(0), tail_(0) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool TryPush(T&& value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = Next(tail);
+        if (next == head_.load(std::memory_order_acquire)) return false;   /* full */
+        slot_list_[tail] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;   /* empty */
+        value = std::move(slot_list_[head]);
+        head_.store(Next(head), std::memory_order_release);
+        return true;
+    }
+
+    /* Approximate when called while the other thread is running */
+    bool Empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t Capacity() const { return slot_list_.size() - 1; }
+
+private:
+    size_t Next(size_t index) const { return (index + 1 == slot_list_.size()) ? 0 : index + 1; }
+
+private:
+    std::vector<T> slot_list_;      /* one slot is always empty to distinguish full from empty */
+    /* head_ and tail_ are on different cache lines to avoid false sharing (padding instead of alignas, for C++14 new) */
+    char padding0_[64];
+    std::atomic<size_t> head_;     /* written by the consumer */
+    char padding1_[64];
+    std::atomic<size_t> tail_;     /* written by the producer */
+};
+
+#endif
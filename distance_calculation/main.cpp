@@ -37,10 +37,16 @@ static constexpr int32_t kWidth = 1280;
 static constexpr int32_t kHeight = 720;
 static constexpr float kFovDeg = 130.0f;
 
+/* for RefinePitch: each lane adds one unknown (lateral position) and each point adds one equation. 2 lanes with 2 points: 4 equations for 3 unknowns */
+static constexpr int32_t kLaneNumMin = 2;
+static constexpr int32_t kLanePointNumMin = 2;
+
 
 /*** Global variable ***/
 static CameraModel camera;
 static std::vector<cv::Point2f> selecting_point_list;
+static bool is_lane_mode = false;                       /* click: add a point to the current lane, right click: start a new lane */
+static std::vector<std::vector<cv::Point2f>> lane_list; /* image points on each lane marking (for RefinePitch) */
 
 /*** Function ***/
 void ResetCameraPose()
@@ -54,6 +60,7 @@ void ResetCamera(int32_t width, int32_t height)
 {
     camera.SetIntrinsic(width, height, FocalLength(width, kFovDeg));
     camera.SetDist({ -0.1f, 0.01f, -0.005f, -0.001f, 0.0f });
+    camera.EnableGroundPlaneMap(4);     /* Use lookup table for ConvertImage2GroundPlane */
     ResetCameraPose();
 }
 
@@ -74,6 +81,12 @@ static void loop_main(const cv::Mat& image_org)
             snprintf(text, sizeof(text), "%.1f, %.1f[m]", object_point_list[i].x, object_point_list[i].z);
             cv::putText(image, text, image_point, cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(255, 0, 0), 2);
         }
+        for (const auto& lane : lane_list) {
+            for (int32_t i = 0; i < lane.size(); i++) {
+                cv::circle(image, lane[i], 5, cv::Scalar(0, 200, 255), -1);
+                if (i > 0) cv::line(image, lane[i - 1], lane[i], cv::Scalar(0, 200, 255), 2);
+            }
+        }
     } else {
         std::vector<cv::Point3f> original_object_point_list;
         for (float x = -10; x <= 10; x += 1) {
@@ -82,7 +95,7 @@ static void loop_main(const cv::Mat& image_org)
             }
         }
         std::vector<cv::Point2f> image_point_list;
-        cv::projectPoints(original_object_point_list, camera.rvec, camera.tvec, camera.K, camera.dist_coeff, image_point_list);
+        cv::projectPoints(original_object_point_list, camera.GetRvec(), camera.GetTvec(), camera.GetK(), camera.GetDistCoeff(), image_point_list);
         image = cv::Mat(kHeight, kWidth, CV_8UC3, cv::Scalar(70, 70, 70));
 
         /* Re-convert image point to object poitn(world) */
@@ -131,12 +144,27 @@ static void loop_param()
         }
         if (cvui::button(120, 20, "ResetImage")) {
             selecting_point_list.clear();
+            lane_list.clear();
+        }
+        cvui::checkbox("Lane Marking", &is_lane_mode);
+        if (cvui::button(120, 20, "RefinePitch")) {
+            /* Each lane is straight and parallel to Zw axis on the ground plane */
+            std::vector<std::vector<cv::Point2f>> lane_valid_list;
+            for (const auto& lane : lane_list) {
+                if (lane.size() >= kLanePointNumMin) lane_valid_list.push_back(lane);
+            }
+            if (lane_valid_list.size() < kLaneNumMin) {
+                printf("RefinePitch: mark at least %d lanes with %d points each (Lane Marking mode)\n", kLaneNumMin, kLanePointNumMin);
+            } else {
+                float rms = camera.RefineExtrinsicOnGround({}, {}, lane_valid_list);
+                printf("RefinePitch: pitch = %.2f [deg], rms = %f\n", Rad2Deg(camera.rx()), rms);
+            }
         }
 
         cvui::text("Camera Parameter (Intrinsic)");
-        MAKE_GUI_SETTING_FLOAT(camera.fx(), "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
-        camera.fy() = camera.fx();
-        camera.UpdateNewCameraMatrix();
+        float focal_length = camera.fx();
+        MAKE_GUI_SETTING_FLOAT(focal_length, "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
+        camera.SetFocalLength(focal_length, focal_length);
 
         cvui::text("Camera Parameter (Extrinsic)");
         float x = -camera.tx();
@@ -164,7 +192,14 @@ static void CallbackMouseMain(int32_t event, int32_t x, int32_t y, int32_t flags
     if (event == cv::EVENT_LBUTTONUP) {
     } else if (event == cv::EVENT_LBUTTONDOWN) {
         cv::Point2f point(static_cast<float>(x), static_cast<float>(y));
-        selecting_point_list.push_back(point);
+        if (is_lane_mode) {
+            if (lane_list.empty()) lane_list.push_back({});
+            lane_list.back().push_back(point);
+        } else {
+            selecting_point_list.push_back(point);
+        }
+    } else if (event == cv::EVENT_RBUTTONDOWN) {
+        if (is_lane_mode && (lane_list.empty() || !lane_list.back().empty())) lane_list.push_back({});
     } else {
     }
 }
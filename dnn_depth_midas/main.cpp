@@ -34,19 +34,56 @@ limitations under the License.
 
 /*** Macro ***/
 static constexpr char kInputImageFilename[] = RESOURCE_DIR"/parrot.jpg";
+static constexpr int32_t kInFlightNum = 3;     /* frames in the async pipeline (capture / pre process / inference / post process) */
 
 
 /*** Global variable ***/
 
 
 /*** Function ***/
+static int32_t DrawResult(const DepthEngine& depth_engine, const DepthEngine::AsyncFrame& frame)
+{
+    const cv::Mat& image_input = frame.image;
+    if (!frame.is_valid || frame.mat_depth_normalized.empty()) return cv::waitKey(1);
+
+    /* Draw Depth */
+    cv::Mat mat_depth_normlized255;
+    cv::resize(frame.mat_depth_normalized, mat_depth_normlized255, image_input.size());
+    cv::Mat image_depth;
+    cv::applyColorMap(mat_depth_normlized255, image_depth, cv::COLORMAP_JET);
+    char text[64];
+    snprintf(text, sizeof(text), "%dx%d, %.1f [ms]", frame.mat_depth.cols, frame.mat_depth.rows, depth_engine.GetLatency());
+    CommonHelper::DrawText(image_depth, text, cv::Point(0, 0), 0.5, 2, CommonHelper::CreateCvColor(0, 0, 0), CommonHelper::CreateCvColor(255, 255, 255));
+    
+    
+    /* Draw Image (only near object) */
+    cv::Mat image_output = cv::Mat(image_input.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+    static int32_t depth_threshold = 255;
+    for (int32_t i = 0; i < image_output.total(); i++) {
+        if (mat_depth_normlized255.at<uint8_t>(i) <= depth_threshold) {
+            image_output.at<cv::Vec3b>(i) = image_input.at<cv::Vec3b>(i);
+        }
+    }
+    cvui::trackbar<int32_t>(image_output, 10, 10, 200, &depth_threshold, 0, 255);
+
+    cv::imshow("Input", image_input);
+    cv::imshow("Depth", image_depth);
+    cv::imshow("Output", image_output);
+    
+    return cv::waitKey(1);
+}
+
 int main(int argc, char *argv[])
 {
     cvui::init("Output");   // use cvui for track bar
 
-    /* Initialize Model */
+    /* Initialize Model (argv[2]: target latency [ms] to select the model by AutoTune) */
     DepthEngine depth_engine;
-    depth_engine.Initialize();
+    if (argc > 2) {
+        if (!depth_engine.AutoTune(DepthEngine::GetModelConfigList(), std::stod(argv[2]))) return -1;
+    } else {
+        if (!depth_engine.Initialize()) return -1;
+    }
 
     /* Find source image */
     std::string input_name = (argc > 1) ? argv[1] : kInputImageFilename;
@@ -54,9 +91,16 @@ int main(int argc, char *argv[])
     if (!CommonHelper::FindSourceImage(input_name, cap)) {
         return -1;
     }
-    
-    /* Process for each frame */
-    for (int32_t frame_cnt = 0; ; frame_cnt++) {
+
+    /***
+    * Pipelined processing
+    *   This thread reads (captures) frames and draws results, and DepthEngine processes the other frames at the same time
+    *   Throughput is bound by the slowest stage (Inference)
+    ***/
+    if (!depth_engine.StartAsync(kInFlightNum)) return -1;
+    DepthEngine::AsyncFrame frame_result;
+    bool is_quit = false;
+    for (int32_t frame_cnt = 0; !is_quit; frame_cnt++) {
         /* Read image */
         cv::Mat image_input;
         if (cap.isOpened()) {
@@ -69,36 +113,23 @@ int main(int argc, char *argv[])
         int32_t input_height = (std::min)(400, image_input.cols);
         cv::resize(image_input, image_input, cv::Size((input_height * image_input.cols) / image_input.rows, input_height));
 
-        /* Estimate depth */
-        cv::Mat mat_depth;
-        depth_engine.Process(image_input, mat_depth);
-
-        /* Draw Depth */
-        cv::Mat mat_depth_normlized255;
-        depth_engine.NormalizeMinMax(mat_depth, mat_depth_normlized255);
-        cv::resize(mat_depth_normlized255, mat_depth_normlized255, image_input.size());
-        cv::Mat image_depth;
-        cv::applyColorMap(mat_depth_normlized255, image_depth, cv::COLORMAP_JET);
-        
-        
-        /* Draw Image (only near object) */
-        cv::Mat image_output = cv::Mat(image_input.size(), CV_8UC3, cv::Scalar(0, 0, 0));
-        static int32_t depth_threshold = 255;
-        for (int32_t i = 0; i < image_output.total(); i++) {
-            if (mat_depth_normlized255.at<uint8_t>(i) <= depth_threshold) {
-                image_output.at<cv::Vec3b>(i) = image_input.at<cv::Vec3b>(i);
+        /* Estimate depth (wait for the oldest result if the pipeline is full) */
+        while (!depth_engine.PushFrame(image_input, frame_cnt)) {
+            if (depth_engine.PopResult(frame_result, true)) {
+                if (DrawResult(depth_engine, frame_result) == 27) is_quit = true;   /* ESC to quit */
             }
         }
-        cvui::trackbar<int32_t>(image_output, 10, 10, 200, &depth_threshold, 0, 255);
-
-        cv::imshow("Input", image_input);
-        cv::imshow("Depth", image_depth);
-        cv::imshow("Output", image_output);
-        
-        int32_t key = cv::waitKey(1);
-        if (key == 27) break;   /* ESC to quit */
+        if (depth_engine.PopResult(frame_result, false)) {
+            if (DrawResult(depth_engine, frame_result) == 27) is_quit = true;   /* ESC to quit */
+        }
+    }
+
+    /* Draw the remaining frames */
+    while (!is_quit && depth_engine.PopResult(frame_result, true)) {
+        DrawResult(depth_engine, frame_result);
     }
 
+    depth_engine.StopAsync();
     depth_engine.Finalize();
     cv::waitKey(-1);
 
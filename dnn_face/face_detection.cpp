@@ -70,12 +70,14 @@ bool FaceDetection::Process(const cv::Mat& image_input, std::vector<cv::Rect>& b
     }
 
     /* PreProcess */
-    cv::Mat blob_input;
-    PreProcess(image_input, blob_input);
+    if (!PreProcess(image_input, blob_input_)) {
+        printf("[FaceDetection::Process] PreProcess failed\n");
+        return false;
+    }
 
     /* Inference */
     std::vector<cv::Mat> output_mat_list;
-    Inference(blob_input, { "loc", "conf", "iou" }, output_mat_list);
+    Inference(blob_input_, { "loc", "conf", "iou" }, output_mat_list);
 
     /* Post Process */
     PostProcess(output_mat_list[0], output_mat_list[1], output_mat_list[2], image_input.size(), bbox_list, landmark_list);
@@ -112,10 +114,11 @@ void FaceDetection::GeneratePriors(const cv::Size& model_input_size)
     }
 }
 
-void FaceDetection::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
+bool FaceDetection::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
 {
-    cv::resize(image_input, blob_input, model_input_size_);
-    blob_input = cv::dnn::blobFromImage(blob_input);
+    /* resize and NHWC(image) -> NCHW in one pass (BGR, 0 - 255). false if image_input is not CV_8UC3 */
+    blob_input.create(std::vector<int32_t>{ 1, 3, model_input_size_.height, model_input_size_.width }, CV_32F);
+    return CommonHelper::CreateBlobFromImage(image_input, blob_input);
 }
 
 void FaceDetection::Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list)
@@ -46,13 +46,14 @@ public:
 
 private:
     void GeneratePriors(const cv::Size& model_input_size);
-    void PreProcess(const cv::Mat& image_input, cv::Mat& blob_input);
+    bool PreProcess(const cv::Mat& image_input, cv::Mat& blob_input);
     void Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list);
     void PostProcess(const cv::Mat& mat_loc, const cv::Mat& mat_conf, const cv::Mat& mat_iou, const cv::Size image_size, std::vector<cv::Rect>& bbox_list, std::vector<Landmark>& landmark_list);
 
 private:
     cv::dnn::Net net_;
     cv::Size model_input_size_;
+    cv::Mat blob_input_;        /* 1 x 3 x H x W. Allocated once and reused */
     std::vector<std::vector<float>> prior_list_;
 };
 
@@ -20,6 +20,7 @@ limitations under the License.
 #include <cmath>
 #include <string>
 #include <vector>
+#include <array>
 
 #include <opencv2/opencv.hpp>
 
@@ -78,7 +79,7 @@ static void loop_main(const cv::Mat& image_org)
 
     /* Convert to image points (2D) */
     std::vector<cv::Point2f> image_point_list;
-    cv::projectPoints(object_point_list, camera.rvec, camera.tvec, camera.K, camera.dist_coeff, image_point_list);
+    cv::projectPoints(object_point_list, camera.GetRvec(), camera.GetTvec(), camera.GetK(), camera.GetDistCoeff(), image_point_list);
 
     /* Affine transform */
     cv::Point2f pts1[] = { cv::Point2f(0, 0), cv::Point2f(image_org.cols - 1.0f, 0) , cv::Point2f(image_org.cols - 1.0f, image_org.rows - 1.0f) , cv::Point2f(0, image_org.rows - 1.0f) };
@@ -118,16 +119,17 @@ static void loop_param()
         }
 
         cvui::text("Camera Parameter (Intrinsic)");
-        MAKE_GUI_SETTING_FLOAT(camera.fx(), "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
-        camera.fy() = camera.fx();
-
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(0), "dist: k1", 0.00001f, "%.05Lf", -0.4f, 0.4f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(1), "dist: k2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(2), "dist: p1", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(3), "dist: p2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(4), "dist: k3", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-
-        camera.UpdateNewCameraMatrix();
+        float focal_length = camera.fx();
+        MAKE_GUI_SETTING_FLOAT(focal_length, "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
+        camera.SetFocalLength(focal_length, focal_length);
+
+        std::array<float, 5> dist = camera.GetDist();
+        MAKE_GUI_SETTING_FLOAT(dist[0], "dist: k1", 0.00001f, "%.05Lf", -0.4f, 0.4f);
+        MAKE_GUI_SETTING_FLOAT(dist[1], "dist: k2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[2], "dist: p1", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[3], "dist: p2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[4], "dist: k3", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        camera.SetDist(dist);
 
         cvui::text("Camera Parameter (Extrinsic)");
         float pitch_deg = Rad2Deg(camera.rx());
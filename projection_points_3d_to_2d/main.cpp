@@ -20,6 +20,7 @@ limitations under the License.
 #include <cmath>
 #include <string>
 #include <vector>
+#include <array>
 
 #include <opencv2/opencv.hpp>
 
@@ -27,6 +28,7 @@ limitations under the License.
 #include "cvui.h"
 
 #include "camera_model.h"
+#include "camera_model_publisher.h"
 
 
 /*** Macro ***/
@@ -44,7 +46,9 @@ static constexpr int32_t kPointNum    = static_cast<int32_t>(kPointRange / kPoin
 
 /*** Global variable ***/
 static bool is_floor_mode = true;
-static CameraModel camera;
+static cv::Point2f cursor_point(-1, -1);
+static CameraModel camera;                      /* modified by GUI / key / mouse */
+static CameraModelPublisher camera_publisher;   /* snapshot of camera for drawing */
 
 /*** Function ***/
 void ResetCameraPoseFloor()
@@ -81,6 +85,10 @@ static void loop_main()
 {
     cvui::context(kWindowMain);
 
+    /* Use a consistent snapshot of the camera during the frame, even if the camera is modified by the other thread */
+    const CameraModelPublisher::Snapshot camera_snapshot = camera_publisher.Get();
+    const CameraModel& camera_current = *camera_snapshot;
+
     /* Generate object points (3D: world coordinate) */
     std::vector<cv::Point3f> object_point_list;
     if (is_floor_mode) {
@@ -97,19 +105,44 @@ static void loop_main()
         }
     }
 
-    /* Convert to image points (2D) */
-    std::vector<cv::Point2f> image_point_list;
-    camera.ConvertWorld2Image(object_point_list, image_point_list);
+    /* Select points in the camera frustum, then convert only them to image points (2D) */
+    std::vector<int32_t> index_list;
+    camera_current.CullPoints(object_point_list, index_list);
+    std::vector<cv::Point3f> object_point_visible_list(index_list.size());
+    for (int32_t k = 0; k < index_list.size(); k++) {
+        object_point_visible_list[k] = object_point_list[index_list[k]];
+    }
+    std::vector<cv::Point2f> image_point_visible_list;
+    camera_current.ConvertWorld2Image(object_point_visible_list, image_point_visible_list);
 
     /* Draw the result */
     cv::Mat mat_output = cv::Mat(kHeight, kWidth, CV_8UC3, cv::Scalar(70, 70, 70));
-    for (int32_t i = 0; i < image_point_list.size(); i++) {
-        if (CheckIfPointInArea(image_point_list[i], mat_output.size())) {
-            if (i % kPointNum != 0) {
-                cv::line(mat_output, image_point_list[i - 1], image_point_list[i], cv::Scalar(220, 0, 0));
+    for (int32_t k = 0; k < index_list.size(); k++) {
+        const int32_t i = index_list[k];
+        const cv::Point2f& image_point = image_point_visible_list[k];
+        if (CheckIfPointInArea(image_point, mat_output.size())) {
+            /* index_list is in ascending order, so the previous point is index_list[k - 1] if it's also in the frustum */
+            if (i % kPointNum != 0 && k > 0 && index_list[k - 1] == i - 1) {
+                cv::line(mat_output, image_point_visible_list[k - 1], image_point, cv::Scalar(220, 0, 0));
             }
-            cv::circle(mat_output, image_point_list[i], 2, cv::Scalar(220, 0, 0));
-            cv::putText(mat_output, std::to_string(i), image_point_list[i], 0, 0.4, cv::Scalar(0, 255, 0));
+            cv::circle(mat_output, image_point, 2, cv::Scalar(220, 0, 0));
+            cv::putText(mat_output, std::to_string(i), image_point, 0, 0.4, cv::Scalar(0, 255, 0));
+        }
+    }
+
+    /* World coordinate of the cursor on the floor (Yw = 0) and the wall (Zw = 0) */
+    if (cursor_point.x >= 0) {
+        static const std::vector<cv::Vec4f> plane_list = { cv::Vec4f(0, 1, 0, 0), cv::Vec4f(0, 0, 1, 0) };
+        static const char* plane_name_list[] = { "Floor", "Wall" };
+        std::vector<std::vector<cv::Point3f>> cursor_object_point_list;
+        std::vector<std::vector<uint8_t>> is_hit_list;
+        camera_current.ConvertImage2Plane({ cursor_point }, plane_list, cursor_object_point_list, is_hit_list);
+        for (int32_t p = 0; p < plane_list.size(); p++) {
+            if (!is_hit_list[p][0]) continue;
+            const cv::Point3f& object_point = cursor_object_point_list[p][0];
+            char text[64];
+            snprintf(text, sizeof(text), "%s: %.1f, %.1f, %.1f", plane_name_list[p], object_point.x, object_point.y, object_point.z);
+            cv::putText(mat_output, text, cursor_point + cv::Point2f(0, 20.0f * p), 0, 0.5, cv::Scalar(0, 255, 255));
         }
     }
 
@@ -152,16 +185,17 @@ static void loop_param()
         cvui::endRow();
 
         cvui::text("Camera Parameter (Intrinsic)");
-        MAKE_GUI_SETTING_FLOAT(camera.fx(), "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
-        camera.fy() = camera.fx();
-
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(0), "dist: k1", 0.00001f, "%.05Lf", -0.4f, 0.4f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(1), "dist: k2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(2), "dist: p1", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(3), "dist: p2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-        MAKE_GUI_SETTING_FLOAT(camera.dist_coeff.at<float>(4), "dist: k3", 0.00001f, "%.05Lf", -0.1f, 0.1f);
-
-        camera.UpdateNewCameraMatrix();
+        float focal_length = camera.fx();
+        MAKE_GUI_SETTING_FLOAT(focal_length, "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
+        camera.SetFocalLength(focal_length, focal_length);
+
+        std::array<float, 5> dist = camera.GetDist();
+        MAKE_GUI_SETTING_FLOAT(dist[0], "dist: k1", 0.00001f, "%.05Lf", -0.4f, 0.4f);
+        MAKE_GUI_SETTING_FLOAT(dist[1], "dist: k2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[2], "dist: p1", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[3], "dist: p2", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        MAKE_GUI_SETTING_FLOAT(dist[4], "dist: k3", 0.00001f, "%.05Lf", -0.1f, 0.1f);
+        camera.SetDist(dist);
 
         cvui::text("Camera Parameter (Extrinsic)");
         float pitch_deg = Rad2Deg(camera.rx());
@@ -197,6 +231,7 @@ static void CallbackMouseMain(int32_t event, int32_t x, int32_t y, int32_t flags
         s_drag_previous_point.x = x;
         s_drag_previous_point.y = y;
     } else {
+        cursor_point = cv::Point2f(static_cast<float>(x), static_cast<float>(y));
         if (s_drag_previous_point.x != kInvalidValue) {
             float delta_yaw = kIncAnglePerPx * (x - s_drag_previous_point.x);
             float pitch_delta = -kIncAnglePerPx * (y - s_drag_previous_point.y);
@@ -268,6 +303,8 @@ int main(int argc, char* argv[])
     ResetCamera(kWidth, kHeight);
 
     while (true) {
+        /* Copied only when the camera is modified */
+        camera_publisher.Publish(camera);
         loop_main();
         loop_param();
         int32_t key = cv::waitKey(1);
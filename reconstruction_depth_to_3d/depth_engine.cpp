@@ -24,6 +24,8 @@ limitations under the License.
 #include <array>
 #include <numeric>
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include <opencv2/opencv.hpp>
 
@@ -32,31 +34,98 @@ limitations under the License.
 
 
 /*** Function ***/
-/* reference: https://github.com/opencv/opencv_zoo/blob/dev/models/face_detection_yunet/yunet.py */
+std::vector<DepthEngine::ModelConfig> DepthEngine::GetModelConfigList()
+{
+    std::vector<ModelConfig> model_config_list(2);
+    model_config_list[0].model_filename = RESOURCE_DIR"/model/midasv2_small_256x256.onnx";
+    model_config_list[0].input_width = 256;
+    model_config_list[0].input_height = 256;
+    model_config_list[0].output_name = "797";
+    model_config_list[1].model_filename = RESOURCE_DIR"/model/midasv2_384x384.onnx";
+    model_config_list[1].input_width = 384;
+    model_config_list[1].input_height = 384;
+    model_config_list[1].output_name = "";
+    return model_config_list;
+}
+
 bool DepthEngine::Initialize()
 {
-    /*  Read Model */
-    try {
-        net_ = cv::dnn::readNetFromONNX(kModelFilename);
-    } catch (std::exception &e) {
-        printf("%s\n", e.what());
-        exit(-1);
+    return Initialize(GetModelConfigList()[0]);
+}
+
+bool DepthEngine::Initialize(const ModelConfig& model_config)
+{
+    if (is_async_running_) {
+        printf("[DepthEngine::Initialize] Async mode is running\n");
+        return false;
     }
-    
-    if (net_.empty() == true) {
-        printf("Failed to create inference engine (%s)\n", kModelFilename);
+    ModelConfig config = model_config;
+    cv::dnn::Net net;
+    if (!LoadModel(config, net)) return false;
+
+    model_config_list_ = { config };
+    net_list_ = { net };
+    is_batch_supported_list_ = { 1 };
+    tuned_latency_list_.clear();
+    target_latency_ms_ = 0;
+    model_index_ = 0;
+    latency_ms_ = 0;
+    frame_cnt_since_switch_ = 0;
+    return true;
+}
+
+bool DepthEngine::AutoTune(const std::vector<ModelConfig>& model_config_list, double target_latency_ms, bool enable_auto_switch)
+{
+    if (is_async_running_) {
+        printf("[DepthEngine::AutoTune] Async mode is running\n");
         return false;
     }
+    model_config_list_.clear();
+    net_list_.clear();
+    is_batch_supported_list_.clear();
+    tuned_latency_list_.clear();
+    target_latency_ms_ = 0;     /* don't switch while tuning */
 
-    /*  Set backend */
-    net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    /* Measure inference time of each model with a dummy image */
+    cv::Mat image_dummy(480, 640, CV_8UC3);
+    cv::randu(image_dummy, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    for (const auto& model_config : model_config_list) {
+        ModelConfig config = model_config;
+        cv::dnn::Net net;
+        if (!LoadModel(config, net)) continue;
+        model_config_list_.push_back(config);
+        net_list_.push_back(net);
+        is_batch_supported_list_.push_back(1);
+        const int32_t model_index = static_cast<int32_t>(net_list_.size()) - 1;
 
-    /* Display model information */
-    for (const auto& layer_name : net_.getUnconnectedOutLayersNames()) {
-        printf("Output layer: %s\n", layer_name.c_str());
+        AllocateBlob(blob_input_, 1, model_index);
+        (void)PreProcess(image_dummy, blob_input_);     /* never fails for CV_8UC3 */
+        std::vector<cv::Mat> output_mat_list;
+        double latency_sum = 0;
+        for (int32_t i = 0; i < kTuneWarmupNum + kTuneMeasureNum; i++) {
+            const auto t0 = std::chrono::steady_clock::now();
+            Inference(model_index, blob_input_, output_mat_list);
+            const auto t1 = std::chrono::steady_clock::now();
+            if (i >= kTuneWarmupNum) latency_sum += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        }
+        tuned_latency_list_.push_back(latency_sum / kTuneMeasureNum);
+        printf("[DepthEngine::AutoTune] %s (%d x %d): %.1f [ms]\n", config.model_filename.c_str(), config.input_width, config.input_height, tuned_latency_list_.back());
+    }
+    if (net_list_.empty()) {
+        printf("[DepthEngine::AutoTune] No model is available\n");
+        return false;
     }
 
+    /* The largest model within the target */
+    int32_t model_index = 0;
+    for (int32_t i = 0; i < static_cast<int32_t>(tuned_latency_list_.size()); i++) {
+        if (tuned_latency_list_[i] <= target_latency_ms) model_index = i;
+    }
+    model_index_ = model_index;
+    latency_ms_ = tuned_latency_list_[model_index];
+    frame_cnt_since_switch_ = 0;
+    target_latency_ms_ = enable_auto_switch ? target_latency_ms : 0;
+    printf("[DepthEngine::AutoTune] Use %s (target = %.1f [ms])\n", model_config_list_[model_index].model_filename.c_str(), target_latency_ms);
     return true;
 }
 
@@ -67,36 +136,268 @@ bool DepthEngine::Finalize()
 
 bool DepthEngine::Process(const cv::Mat& image_input, cv::Mat& mat_depth)
 {
+    if (net_list_.empty()) {
+        printf("[DepthEngine::Process] Not initialized\n");
+        return false;
+    }
+    const int32_t model_index = model_index_;   /* the model may be switched in Inference */
+
     /* PreProcess */
-    cv::Mat blob_input;
-    PreProcess(image_input, blob_input);
+    AllocateBlob(blob_input_, 1, model_index);
+    if (!PreProcess(image_input, blob_input_)) {
+        printf("[DepthEngine::Process] PreProcess failed\n");
+        return false;
+    }
 
     /* Inference */
     std::vector<cv::Mat> output_mat_list;
-    Inference(blob_input, { "797" }, output_mat_list);
+    Inference(model_index, blob_input_, output_mat_list);
 
     /* Post Process */
-    /* Inverse relative depth (Far = small Value, Near = huge value) */
-    mat_depth = cv::Mat(kModelInputHeight, kModelInputWidth, CV_32FC1, output_mat_list[0].data);
-    mat_depth = mat_depth.clone();  /* I need to clone it because output_mat_list is destroyed */
+    cv::Mat& depth_buffer = depth_buffer_list_[depth_buffer_index_];
+    depth_buffer_index_ = (depth_buffer_index_ + 1) % static_cast<int32_t>(depth_buffer_list_.size());
+    PostProcess(model_index, output_mat_list, depth_buffer);
+    mat_depth = depth_buffer;
 
     return true;
 }
 
+bool DepthEngine::ProcessBatch(const std::vector<cv::Mat>& image_input_list, std::vector<cv::Mat>& mat_depth_list)
+{
+    mat_depth_list.clear();
+    if (net_list_.empty()) {
+        printf("[DepthEngine::ProcessBatch] Not initialized\n");
+        return false;
+    }
+    const int32_t batch_size = static_cast<int32_t>(image_input_list.size());
+    if (batch_size == 0) return true;
+    if (batch_size > kMaxBatchSize) {
+        printf("[DepthEngine::ProcessBatch] Too many images: %d (max = %d)\n", batch_size, kMaxBatchSize);
+        return false;
+    }
+    const int32_t model_index = model_index_;   /* the model may be switched in Inference */
+    const int32_t height = model_config_list_[model_index].input_height;
+    const int32_t width = model_config_list_[model_index].input_width;
+
+    if (is_batch_supported_list_[model_index]) {
+        /* PreProcess: N x 3 x H x W */
+        AllocateBlob(blob_batch_, batch_size, model_index);
+        for (int32_t i = 0; i < batch_size; i++) {
+            if (!PreProcess(image_input_list[i], blob_batch_, i)) {
+                printf("[DepthEngine::ProcessBatch] PreProcess failed (image %d)\n", i);
+                return false;
+            }
+        }
+
+        /* Inference */
+        std::vector<cv::Mat> output_mat_list;
+        try {
+            Inference(model_index, blob_batch_, output_mat_list);
+        } catch (cv::Exception& e) {
+            if (batch_size == 1) {
+                printf("[DepthEngine::ProcessBatch] %s\n", e.what());
+                return false;
+            }
+            printf("[DepthEngine::ProcessBatch] The model doesn't accept batch size %d. Images are processed one by one\n", batch_size);
+            is_batch_supported_list_[model_index] = 0;
+        }
+
+        if (is_batch_supported_list_[model_index] && output_mat_list[0].total() != static_cast<size_t>(batch_size) * height * width) {
+            if (batch_size == 1) {
+                printf("[DepthEngine::ProcessBatch] Unexpected output size\n");
+                return false;
+            }
+            /* e.g. a model exported with a fixed batch size of 1 returns 1 x H x W without error */
+            printf("[DepthEngine::ProcessBatch] The model doesn't output batch size %d. Images are processed one by one\n", batch_size);
+            is_batch_supported_list_[model_index] = 0;
+        }
+
+        if (is_batch_supported_list_[model_index]) {
+            /* Post Process: split N x H x W into N views of H x W (refer to the same buffer) */
+            batch_output_ = output_mat_list[0].reshape(1, batch_size * height);
+            for (int32_t i = 0; i < batch_size; i++) {
+                mat_depth_list.push_back(batch_output_.rowRange(i * height, (i + 1) * height));
+            }
+            return true;
+        }
+    }
+
+    /* Fallback: one by one (the network output may be overwritten by the next inference, so it's copied) */
+    /* batch_output_ may refer to the output buffer of the network (batch path). Release it, so that create doesn't write into that buffer */
+    batch_output_.release();
+    batch_output_.create(batch_size * height, width, CV_32FC1);
+    AllocateBlob(blob_input_, 1, model_index);
+    for (int32_t i = 0; i < batch_size; i++) {
+        if (!PreProcess(image_input_list[i], blob_input_)) {
+            printf("[DepthEngine::ProcessBatch] PreProcess failed (image %d)\n", i);
+            mat_depth_list.clear();
+            return false;
+        }
+        std::vector<cv::Mat> output_mat_list;
+        Inference(model_index, blob_input_, output_mat_list);
+        cv::Mat mat_depth = batch_output_.rowRange(i * height, (i + 1) * height);
+        PostProcess(model_index, output_mat_list, mat_depth);
+        mat_depth_list.push_back(mat_depth);
+    }
+    return true;
+}
+
+
+bool DepthEngine::StartAsync(int32_t in_flight_num, const std::array<int32_t, kStageNum>& cpu_list)
+{
+    if (is_async_running_) {
+        printf("[DepthEngine::StartAsync] Already running\n");
+        return false;
+    }
+    if (in_flight_num < 1) {
+        printf("[DepthEngine::StartAsync] Invalid in_flight_num: %d\n", in_flight_num);
+        return false;
+    }
+    if (net_list_.empty()) {
+        printf("[DepthEngine::StartAsync] Not initialized\n");
+        return false;
+    }
+
+    /* Each queue can hold all the frames in flight, so TryPush between stages never fails */
+    in_flight_num_ = in_flight_num;
+    in_flight_cnt_ = 0;
+    queue_list_.clear();
+    blob_pool_.resize(in_flight_num);
+    depth_pool_.resize(in_flight_num + 1);
+    depth_normalized_pool_.resize(in_flight_num + 1);
+    for (int32_t i = 0; i <= kStageNum; i++) {
+        queue_list_.push_back(std::unique_ptr<SpscQueue<AsyncFrame>>(new SpscQueue<AsyncFrame>(in_flight_num)));
+    }
+
+    /* Create the OpenCV thread pool from this (not pinned) thread, otherwise the workers inherit the affinity of the stage which uses it first */
+    cv::parallel_for_(cv::Range(0, cv::getNumThreads()), [](const cv::Range&) {});
+
+    is_async_running_ = true;
+    for (int32_t stage = 0; stage < kStageNum; stage++) {
+        thread_list_.push_back(std::thread(&DepthEngine::RunStage, this, stage, cpu_list[stage]));
+    }
+    return true;
+}
+
+void DepthEngine::StopAsync()
+{
+    if (!is_async_running_) return;
+    is_async_running_ = false;
+    for (auto& t : thread_list_) t.join();
+    thread_list_.clear();
+    queue_list_.clear();    /* frames in flight are discarded */
+    in_flight_cnt_ = 0;
+}
+
+bool DepthEngine::PushFrame(const cv::Mat& image, int64_t id)
+{
+    if (!is_async_running_) {
+        printf("[DepthEngine::PushFrame] Async mode is not running\n");
+        return false;
+    }
+    if (in_flight_cnt_ >= in_flight_num_) return false;
+    AsyncFrame frame;
+    frame.id = id;
+    frame.image = image;
+    in_flight_cnt_++;
+    queue_list_[kStagePreProcess]->TryPush(std::move(frame));
+    return true;
+}
+
+bool DepthEngine::PopResult(AsyncFrame& frame, bool wait)
+{
+    if (!is_async_running_) return false;
+    while (!queue_list_[kStageNum]->TryPop(frame)) {
+        if (!wait || in_flight_cnt_ == 0) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    in_flight_cnt_--;
+    return true;
+}
+
+void DepthEngine::RunStage(int32_t stage, int32_t cpu_id)
+{
+    if (!CommonHelper::SetThreadAffinity(cpu_id)) {
+        printf("[DepthEngine::RunStage] Failed to set affinity of stage %d to cpu %d\n", stage, cpu_id);
+    }
+
+    SpscQueue<AsyncFrame>& queue_in = *queue_list_[stage];
+    SpscQueue<AsyncFrame>& queue_out = *queue_list_[stage + 1];
+    AsyncFrame frame;
+    int32_t frame_cnt = 0;
+    std::vector<cv::Mat> output_mat_list;   /* may refer to the output buffer of the network. Valid until the next forward */
+    while (is_async_running_) {
+        if (!queue_in.TryPop(frame)) {
+            /* Frames arrive at most at the inference rate, so polling with a short sleep costs little */
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        switch (stage) {
+        case kStagePreProcess:
+            {
+                /* At most in_flight_num frames are in the pipeline, so the blob is no longer used by the previous owner */
+                cv::Mat& blob_input = blob_pool_[frame_cnt++ % blob_pool_.size()];
+                frame.model_index = model_index_;
+                AllocateBlob(blob_input, 1, frame.model_index);
+                frame.is_valid = PreProcess(frame.image, blob_input);
+                frame.blob_input = blob_input;
+            }
+            break;
+        case kStageInference:
+            {
+                /* The result of frame N is overwritten by frame N + in_flight_num + 1, which can't be pushed until frame N + 1 is popped */
+                const size_t index = frame_cnt++ % depth_pool_.size();
+                /* A failed frame is still passed to the next stage, so that PopResult returns frames in the pushed order */
+                if (frame.is_valid) {
+                    try {
+                        Inference(frame.model_index, frame.blob_input, output_mat_list);
+                        /* Copy the output here, because the next forward may overwrite it while the post process stage is using it */
+                        PostProcess(frame.model_index, output_mat_list, depth_pool_[index]);
+                        frame.mat_depth = depth_pool_[index];
+                    } catch (std::exception& e) {
+                        printf("[DepthEngine::RunStage] Inference failed (frame %lld): %s\n", static_cast<long long>(frame.id), e.what());
+                        frame.is_valid = false;
+                    }
+                }
+                frame.blob_input.release();
+            }
+            break;
+        case kStagePostProcess:
+        default:
+            {
+                /* Frames come in the same order as the Inference stage, so index is the same as the one used for mat_depth */
+                const size_t index = frame_cnt++ % depth_normalized_pool_.size();
+                if (!frame.is_valid) {
+                    frame.mat_depth.release();
+                    frame.mat_depth_normalized.release();
+                    break;
+                }
+                if (NormalizeMinMax(frame.mat_depth, depth_normalized_pool_[index])) {
+                    frame.mat_depth_normalized = depth_normalized_pool_[index];
+                } else {
+                    frame.mat_depth_normalized.release();
+                }
+            }
+            break;
+        }
+        queue_out.TryPush(std::move(frame));
+    }
+}
+
 
 bool DepthEngine::NormalizeMinMax(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized)
 {
     /***
     * Normalize to uint8_t(0-255) (Far = 255, Neat = 0)
-    * Normalized Value  = 255 * (value - min) / (max - min)
+    * Normalized Value  = 255 - 255 * (value - min) / (max - min)
     ***/
-    mat_depth_normalized = cv::Mat(kModelInputHeight, kModelInputWidth, CV_8UC1);
     double depth_min, depth_max;
     cv::minMaxLoc(mat_depth, &depth_min, &depth_max);
     double range = depth_max - depth_min;
     if (range > 0) {
-        mat_depth.convertTo(mat_depth_normalized, CV_8UC1, 255. / range, (-255. * depth_min) / range);
-        mat_depth_normalized = 255 - mat_depth_normalized;
+        /* One pass into the buffer of the caller (convertTo doesn't reallocate if the size and type match) */
+        mat_depth_normalized.create(mat_depth.size(), CV_8UC1);
+        mat_depth.convertTo(mat_depth_normalized, CV_8UC1, -255. / range, 255. + (255. * depth_min) / range);
         return true;
     } else {
         return false;
@@ -109,35 +410,111 @@ bool DepthEngine::NormalizeScaleShift(const cv::Mat& mat_depth, cv::Mat& mat_dep
     * Normalize to float (Far = huge value, Near = small value)
     * 1 / Normalized Value = Estimated Depth(inverse relative depth) * scale + shift
     ***/
-    mat_depth_normalized = cv::Mat(kModelInputHeight, kModelInputWidth, CV_32FC1);
+    mat_depth_normalized.create(mat_depth.size(), CV_32FC1);
     mat_depth.convertTo(mat_depth_normalized, CV_32FC1, scale, shift);
-    mat_depth_normalized = 1.0 / mat_depth_normalized;
+    cv::divide(1.0, mat_depth_normalized, mat_depth_normalized);    /* in place */
+    return true;
+}
+
+/* reference: https://github.com/opencv/opencv_zoo/blob/dev/models/face_detection_yunet/yunet.py */
+bool DepthEngine::LoadModel(ModelConfig& model_config, cv::dnn::Net& net)
+{
+    /*  Read Model */
+    try {
+        net = cv::dnn::readNetFromONNX(model_config.model_filename);
+    } catch (std::exception &e) {
+        printf("%s\n", e.what());
+        return false;
+    }
+    
+    if (net.empty() == true) {
+        printf("Failed to create inference engine (%s)\n", model_config.model_filename.c_str());
+        return false;
+    }
+
+    /*  Set backend */
+    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+    /* Display model information */
+    const auto& output_layer_name_list = net.getUnconnectedOutLayersNames();
+    for (const auto& layer_name : output_layer_name_list) {
+        printf("Output layer: %s\n", layer_name.c_str());
+    }
+    if (model_config.output_name.empty() && !output_layer_name_list.empty()) {
+        model_config.output_name = output_layer_name_list[0];
+    }
+
     return true;
 }
 
-void DepthEngine::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
+void DepthEngine::AllocateBlob(cv::Mat& blob_input, int32_t batch_size, int32_t model_index)
 {
-    cv::Mat image_normalize;
-    cv::resize(image_input, image_normalize, cv::Size(kModelInputWidth, kModelInputHeight));
-    cv::cvtColor(image_normalize, image_normalize, cv::COLOR_BGR2RGB);
-    image_normalize.convertTo(image_normalize, CV_32FC3, 1.0 / 255.0);
-    cv::subtract(image_normalize, cv::Scalar(cv::Vec<float, 3>(kMeanList[0], kMeanList[1], kMeanList[2])), image_normalize);
-    cv::divide(image_normalize, cv::Scalar(cv::Vec<float, 3>(kNormList[0], kNormList[1], kNormList[2])), image_normalize);
+    /* Allocated only if the size is changed */
+    const ModelConfig& config = model_config_list_[model_index];
+    blob_input.create(std::vector<int32_t>{ batch_size, 3, config.input_height, config.input_width }, CV_32F);
+}
 
-    /*
-    const std::vector<int> sizes = { 1, image_normalize.rows, image_normalize.cols, image_normalize.channels() };
-    cv::Mat mat(sizes, CV_32F, image_normalize.data);
-    blob_input = mat.clone();
-    printf(" % d, \n", mat.size().width);
-    */
+bool DepthEngine::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input, int32_t batch_index)
+{
+    /* resize, BGR -> RGB, (value / 255 - mean) / norm, NHWC(image) -> NCHW in one pass (blob_input is allocated by AllocateBlob) */
+    /* false if image_input is not CV_8UC3 */
+    return CommonHelper::CreateBlobFromImage(image_input, blob_input, batch_index, true, 1.0f / 255.0f, kMeanList, kNormList);
+}
 
-    /* NHWC(image) -> NCHW */
-    blob_input = cv::dnn::blobFromImage(image_normalize);
+void DepthEngine::PostProcess(int32_t model_index, const std::vector<cv::Mat>& output_mat_list, cv::Mat& mat_depth)
+{
+    /***
+    * Inverse relative depth (Far = small Value, Near = huge value)
+    * The output of the network may refer to its internal buffer which is overwritten by the next forward, so it's copied into mat_depth (buffer owned by the engine. allocated only once)
+    ***/
+    const ModelConfig& config = model_config_list_[model_index];
+    mat_depth.create(config.input_height, config.input_width, CV_32FC1);
+    cv::Mat(config.input_height, config.input_width, CV_32FC1, output_mat_list[0].data).copyTo(mat_depth);
+}
 
+void DepthEngine::Inference(int32_t model_index, const cv::Mat& blob_input, std::vector<cv::Mat>& output_mat_list)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    cv::dnn::Net& net = net_list_[model_index];
+    net.setInput(blob_input);
+    net.forward(output_mat_list, std::vector<cv::String>{ model_config_list_[model_index].output_name });
+    const auto t1 = std::chrono::steady_clock::now();
+    UpdateLatency(model_index, std::chrono::duration<double, std::milli>(t1 - t0).count() / blob_input.size[0]);
 }
 
-void DepthEngine::Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list)
+void DepthEngine::UpdateLatency(int32_t model_index, double latency_ms)
 {
-    net_.setInput(blob_input);
-    net_.forward(output_mat_list, output_name_list);
+    /* Called only from the thread doing Inference */
+    /* Frames preprocessed before a switch are inferred with the previous model. They are not counted */
+    if (model_index != model_index_) return;
+    if (latency_ms_ <= 0) {
+        latency_ms_ = latency_ms;   /* the first frame after Initialize */
+    } else {
+        latency_ms_ = latency_ms_ * (1.0 - kLatencyEmaAlpha) + latency_ms * kLatencyEmaAlpha;
+    }
+
+    /* Model switch is done only when enabled by AutoTune */
+    if (target_latency_ms_ <= 0) return;
+    if (++frame_cnt_since_switch_ < kSwitchIntervalFrame) return;
+
+    /* Estimate latency of the other models: (latency at tuning) * (current load) */
+    const double load = latency_ms_ / tuned_latency_list_[model_index];
+    int32_t model_index_new = model_index;
+    if (latency_ms_ > target_latency_ms_ * kSwitchDownRatio && model_index > 0) {
+        model_index_new = 0;
+        for (int32_t i = 0; i < model_index; i++) {
+            if (tuned_latency_list_[i] * load <= target_latency_ms_) model_index_new = i;
+        }
+    } else if (model_index + 1 < static_cast<int32_t>(tuned_latency_list_.size()) && tuned_latency_list_[model_index + 1] * load < target_latency_ms_ * kSwitchUpRatio) {
+        model_index_new = model_index + 1;
+    }
+
+    if (model_index_new != model_index) {
+        printf("[DepthEngine] Switch model: %s -> %s (latency = %.1f [ms], target = %.1f [ms])\n",
+            model_config_list_[model_index].model_filename.c_str(), model_config_list_[model_index_new].model_filename.c_str(), latency_ms_.load(), target_latency_ms_);
+        latency_ms_ = tuned_latency_list_[model_index_new] * load;
+        frame_cnt_since_switch_ = 0;
+        model_index_ = model_index_new;
+    }
 }
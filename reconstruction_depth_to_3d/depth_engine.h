@@ -20,9 +20,14 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include <array>
+#include <memory>
+#include <thread>
+#include <atomic>
 
 #include <opencv2/opencv.hpp>
 
+#include "spsc_queue.h"
+
 
 class DepthEngine
 {
@@ -30,27 +35,140 @@ public:
     typedef std::array<cv::Point, 5> Landmark;
 
 private:
-    static constexpr char kModelFilename[] = RESOURCE_DIR"/model/midasv2_small_256x256.onnx";
-    static constexpr int32_t kModelInputWidth = 256;
-    static constexpr int32_t kModelInputHeight = 256;
+    static constexpr int32_t kMaxBatchSize = 8;
     const std::array<float, 3> kMeanList = { 0.485f, 0.456f, 0.406f };
     const std::array<float, 3> kNormList = { 0.229f, 0.224f, 0.225f };
 
+    /* for AutoTune */
+    static constexpr int32_t kTuneWarmupNum = 2;
+    static constexpr int32_t kTuneMeasureNum = 5;
+    static constexpr double kLatencyEmaAlpha = 0.1;
+    static constexpr int32_t kSwitchIntervalFrame = 30;     /* frames to measure after tuning / switching before the next switch */
+    static constexpr double kSwitchDownRatio = 1.1;         /* switch to a smaller model if latency > target * ratio */
+    static constexpr double kSwitchUpRatio = 0.8;           /* switch to a larger model if its estimated latency < target * ratio */
+
+public:
+    /* Model variant (chosen at runtime) */
+    struct ModelConfig {
+        std::string model_filename;
+        int32_t input_width = 256;
+        int32_t input_height = 256;
+        std::string output_name;        /* empty: the first output layer of the model */
+    };
+
+    /* Frame in the async pipeline */
+    struct AsyncFrame {
+        int64_t id = 0;
+        int32_t model_index = 0;        /* model used for the frame (PreProcess) */
+        bool is_valid = true;           /* false if a stage failed (unsupported image type, exception in forward). mat_depth and mat_depth_normalized are empty */
+        cv::Mat image;                  /* input image (as pushed) */
+        cv::Mat blob_input;             /* PreProcess */
+        cv::Mat mat_depth;              /* Inference: the same as Process() (copied from the network output before the next forward) */
+        cv::Mat mat_depth_normalized;   /* post process: NormalizeMinMax (empty if failed) */
+        /* mat_depth and mat_depth_normalized refer to output buffers owned by the engine. Valid until the next PopResult */
+    };
+
+    enum {
+        kStagePreProcess = 0,
+        kStageInference,
+        kStagePostProcess,
+        kStageNum,
+    };
+
 public:
     DepthEngine() {}
-    ~DepthEngine() {}
-    bool Initialize();
+    ~DepthEngine() { StopAsync(); }
+    /* Models in resource/model, from small (fast) to large (accurate) */
+    static std::vector<ModelConfig> GetModelConfigList();
+    bool Initialize();      /* the first model of GetModelConfigList() */
+    bool Initialize(const ModelConfig& model_config);
+    /***
+    * Select the model by latency on this host
+    *   model_config_list: from small (fast) to large (accurate). Models which can't be loaded are skipped
+    *   Inference time of each model is measured, and the largest model within target_latency_ms is used (the smallest one if none)
+    *   enable_auto_switch: keep measuring inference time, and switch to a smaller / larger model when the load of the host changes
+    *     The inference time of the other models is estimated from the measured time at tuning and the current load
+    *   Latency is inference time per frame (PreProcess and PostProcess don't depend on the model so much)
+    ***/
+    bool AutoTune(const std::vector<ModelConfig>& model_config_list, double target_latency_ms, bool enable_auto_switch = true);
+    const ModelConfig& GetModelConfig() const { return model_config_list_[model_index_]; }
+    double GetLatency() const { return latency_ms_; }   /* [ms] moving average of inference time */
     bool Finalize();
+    /***
+    * mat_depth: refers to the output buffer owned by the engine (no allocation per frame)
+    *   Output buffers are double-buffered, so mat_depth is valid until the next-next Process call (the previous result can be held while processing the next frame)
+    *   Don't write into mat_depth. clone() to keep it longer
+    ***/
     bool Process(const cv::Mat& image_input, cv::Mat& mat_depth);
+    /***
+    * Process multiple images (frames, tiles, images from several streams) in one forward pass
+    *   image_input_list: up to kMaxBatchSize images (any size. each image is resized to the model input size)
+    *   mat_depth_list: views of the output buffer owned by the engine (no copy)
+    *     Valid until the next Process / ProcessBatch call (the network may reuse its output buffer). clone() to keep it longer
+    *   If the model doesn't accept batch size > 1, images are processed one by one and copied into the output buffer
+    *   Returns false (mat_depth_list is empty) if any image can't be processed (e.g. not CV_8UC3)
+    ***/
+    bool ProcessBatch(const std::vector<cv::Mat>& image_input_list, std::vector<cv::Mat>& mat_depth_list);
+    /* mat_depth_normalized is written into the buffer provided by the caller (allocated only if its size or type doesn't match) */
     bool NormalizeMinMax(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized);
     bool NormalizeScaleShift(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized, float scale, float shift);
 
+    /***
+    * Async mode: PreProcess, Inference and post process run on their own threads, connected with bounded lock-free queues
+    *   The Inference stage copies the network output into the buffer of the frame before the next forward, and the post process stage normalizes it
+    *   The caller (capture) thread pushes frames and pops results, so every stage works on a different frame at the same time
+    *   in_flight_num: max number of frames in the pipeline (pushed but not popped yet). 3 or more to keep Inference busy
+    *   cpu_list: CPU core for each stage (kStagePreProcess, kStageInference, kStagePostProcess). -1 = not pinned
+    *     Threads created from a pinned stage inherit its affinity, so they run only on that core:
+    *     the OpenMP team of the stage (PreProcess uses OpenMP), and cv::dnn workers if OpenCV is built with the OpenMP backend
+    *     The OpenCV thread pool (pthreads / TBB backend) is created in StartAsync before the stages are pinned, so cv::dnn in the Inference stage uses all cores
+    *   Process() must not be called while the async mode is running (the networks are used by the Inference thread)
+    *   Model switch by AutoTune works in the async mode too (frames already preprocessed are processed with the previous model)
+    ***/
+    bool StartAsync(int32_t in_flight_num = 3, const std::array<int32_t, kStageNum>& cpu_list = { -1, -1, -1 });
+    void StopAsync();
+    /* Returns false without blocking if in_flight_num frames are already in the pipeline. image is not copied, so don't modify it */
+    bool PushFrame(const cv::Mat& image, int64_t id);
+    /* Results come in the pushed order. wait = true: block until a result is ready (returns false if the pipeline is empty) */
+    bool PopResult(AsyncFrame& frame, bool wait);
+
 private:
-    void PreProcess(const cv::Mat& image_input, cv::Mat& blob_input);
-    void Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list);
+    bool LoadModel(ModelConfig& model_config, cv::dnn::Net& net);
+    void AllocateBlob(cv::Mat& blob_input, int32_t batch_size, int32_t model_index);
+    bool PreProcess(const cv::Mat& image_input, cv::Mat& blob_input, int32_t batch_index = 0);
+    void Inference(int32_t model_index, const cv::Mat& blob_input, std::vector<cv::Mat>& output_mat_list);
+    void PostProcess(int32_t model_index, const std::vector<cv::Mat>& output_mat_list, cv::Mat& mat_depth);
+    void UpdateLatency(int32_t model_index, double latency_ms);
+    void RunStage(int32_t stage, int32_t cpu_id);
 
 private:
-    cv::dnn::Net net_;
+    /* Loaded models (model_index_ is the current one) */
+    std::vector<ModelConfig> model_config_list_;
+    std::vector<cv::dnn::Net> net_list_;
+    std::vector<uint8_t> is_batch_supported_list_;
+    std::atomic<int32_t> model_index_{ 0 };
+
+    /* for AutoTune */
+    std::vector<double> tuned_latency_list_;    /* [ms] measured at tuning */
+    double target_latency_ms_ = 0;      /* 0 = auto switch is disabled */
+    std::atomic<double> latency_ms_{ 0 };
+    int32_t frame_cnt_since_switch_ = 0;
+
+    cv::Mat blob_input_;        /* 1 x 3 x H x W. Allocated once and reused */
+    cv::Mat blob_batch_;        /* N x 3 x H x W for ProcessBatch */
+    std::array<cv::Mat, 2> depth_buffer_list_;     /* output of Process (double buffer) */
+    int32_t depth_buffer_index_ = 0;
+    cv::Mat batch_output_;      /* N x H x W (from the network), or (N * H) x W (copied when batch is not supported) */
+
+    /* for async mode: queue_list_[i] is the input of stage i, queue_list_[kStageNum] is the output of the pipeline */
+    std::vector<std::unique_ptr<SpscQueue<AsyncFrame>>> queue_list_;
+    std::vector<std::thread> thread_list_;
+    std::vector<cv::Mat> blob_pool_;    /* input blobs for frames in flight (used in turn) */
+    std::vector<cv::Mat> depth_pool_;   /* output buffers for frames in flight and the last popped frame (used in turn) */
+    std::vector<cv::Mat> depth_normalized_pool_;
+    std::atomic<bool> is_async_running_{ false };
+    std::atomic<int32_t> in_flight_cnt_{ 0 };
+    int32_t in_flight_num_ = 0;
 
 };
 
@@ -31,6 +31,7 @@ limitations under the License.
 #include "common_helper_cv.h"
 #include "depth_engine.h"
 #include "camera_model.h"
+#include "camera_rig.h"
 
 /*** Macro ***/
 static constexpr char kInputImageFilename[] = RESOURCE_DIR"/room_02.jpg";
@@ -39,10 +40,16 @@ static constexpr int32_t kCamera3d2dWidth = 640;
 static constexpr int32_t kCamera3d2dHeight = 480;
 static constexpr float   kCamera3d2dFovDeg = 80.0f;
 #define NORMALIZE_BY_255
+#ifdef NORMALIZE_BY_255
+static constexpr float   kPointBucketSize = 16.0f;     /* for frustum culling */
+#else
+static constexpr float   kPointBucketSize = 0.001f;
+#endif
 
 /*** Global variable ***/
 static CameraModel camera_2d_to_3d;
 static CameraModel camera_3d_to_2d;
+static CameraRig camera_rig_3d_to_2d;   /* camera_3d_to_2d. Add more cameras to render from multiple views */
 
 /*** Function ***/
 static void SaveAsPly(const cv::Mat& image_input, const std::vector<cv::Point3f>& object_point_list, const std::string filename)
@@ -165,18 +172,12 @@ static void TreatKeyInputMain(int32_t key)
     }
 }
 
-static bool CheckIfPointInArea(const cv::Point& p, const cv::Size& r)
-{
-    if (p.x < 0 || p.y < 0 || p.x >= r.width || p.y >= r.height) return false;
-    return true;
-}
-
 
 int main(int argc, char* argv[])
 {
     /* Initialize Model */
     DepthEngine depth_engine;
-    depth_engine.Initialize();
+    if (!depth_engine.Initialize()) return -1;
 
     /* Find source image */
     std::string input_name = (argc > 1) ? argv[1] : kInputImageFilename;
@@ -197,10 +198,11 @@ int main(int argc, char* argv[])
     cv::resize(image_input, image_input, cv::Size(), 0.5, 0.5);
 
     InitializeCamera(image_input.cols, image_input.rows);
+    camera_rig_3d_to_2d.AddCamera(&camera_3d_to_2d);
 
     /* Estimate depth */
     cv::Mat mat_depth;
-    depth_engine.Process(image_input, mat_depth);
+    if (!depth_engine.Process(image_input, mat_depth)) return -1;
 
     /* Draw depth */
     cv::Mat mat_depth_normlized255;
@@ -233,27 +235,41 @@ int main(int argc, char* argv[])
 
     SaveAsPly(image_input, object_point_list, "my_point_cloud.ply");
 
+    /* Divide the point cloud into buckets so that culling can skip buckets out of the camera */
+    PointBucket point_bucket;
+    point_bucket.Build(object_point_list, kPointBucketSize);
+
     while(true) {
-        /* Project 3D to 2D(new image) */
-        std::vector<cv::Point2f> image_point_list;
-        camera_3d_to_2d.ConvertWorld2Image(object_point_list, image_point_list);
+        /* Select points in the camera frustum */
+        std::vector<int32_t> index_list;
+        camera_3d_to_2d.CullPoints(object_point_list, point_bucket, index_list);
+        std::vector<cv::Point3f> object_point_visible_list(index_list.size());
+        for (int32_t k = 0; k < index_list.size(); k++) {
+            object_point_visible_list[k] = object_point_list[index_list[k]];
+        }
 
-        /* Generate object points in camera coordinate to draw the object in Zc order, from far to near (instead of using Z buffer) */
-        std::vector<cv::Point3f> object_point_in_camera_list;
-        camera_3d_to_2d.ConvertWorld2Camera(object_point_list, object_point_in_camera_list);
+        /* Project 3D to 2D(new image) */
+        /* Zc is also generated to draw the object in Zc order, from far to near (instead of using Z buffer) */
+        std::vector<std::vector<cv::Point2f>> image_point_list_list;
+        std::vector<std::vector<uint8_t>> is_visible_list_list;
+        std::vector<std::vector<float>> depth_list_list;
+        camera_rig_3d_to_2d.ConvertWorld2Image(object_point_visible_list, image_point_list_list, is_visible_list_list, &depth_list_list);
+        const std::vector<cv::Point2f>& image_point_list = image_point_list_list[0];
+        const std::vector<uint8_t>& is_visible_list = is_visible_list_list[0];
+        const std::vector<float>& depth_in_camera_list = depth_list_list[0];
 
         /* Argsort by depth (index_0 = Far, index_len-1 = Near)*/
-        std::vector<int32_t> indices_depth(object_point_in_camera_list.size());
+        std::vector<int32_t> indices_depth(depth_in_camera_list.size());
         std::iota(indices_depth.begin(), indices_depth.end(), 0);
-        std::sort(indices_depth.begin(), indices_depth.end(), [&object_point_in_camera_list](int32_t i1, int32_t i2) {
-            return object_point_in_camera_list[i1].z > object_point_in_camera_list[i2].z;
+        std::sort(indices_depth.begin(), indices_depth.end(), [&depth_in_camera_list](int32_t i1, int32_t i2) {
+            return depth_in_camera_list[i1] > depth_in_camera_list[i2];
         });
 
         /* Draw the result */
-        cv::Mat mat_output = cv::Mat(camera_3d_to_2d.height, camera_3d_to_2d.width, CV_8UC3, cv::Scalar(0, 0, 0));
-        for (int32_t i : indices_depth) {
-            if (CheckIfPointInArea(image_point_list[i], mat_output.size())) {
-                cv::circle(mat_output, image_point_list[i], 4, image_input.at<cv::Vec3b>(i), -1);
+        cv::Mat mat_output = cv::Mat(camera_3d_to_2d.GetHeight(), camera_3d_to_2d.GetWidth(), CV_8UC3, cv::Scalar(0, 0, 0));
+        for (int32_t k : indices_depth) {
+            if (is_visible_list[k]) {
+                cv::circle(mat_output, image_point_list[k], 4, image_input.at<cv::Vec3b>(index_list[k]), -1);
             }
         }
 
@@ -27,6 +27,7 @@ limitations under the License.
 #include "cvui.h"
 
 #include "camera_model.h"
+#include "camera_rig.h"
 
 /*** Macro ***/
 static constexpr char kWindowMain[] = "WindowMain";
@@ -37,6 +38,7 @@ static constexpr float kFovDeg = 130.0f;
 /*** Global variable ***/
 static CameraModel camera_real;
 static CameraModel camera_top;
+static CameraRig camera_rig;    /* camera_real, camera_top */
 
 
 /*** Function ***/
@@ -72,12 +74,12 @@ static void loop_main(const cv::Mat& image_org)
         { -1.0f, 0,  3.0f },
         {  1.0f, 0,  3.0f },
     };
-    std::vector<cv::Point2f> image_point_real_list;
-    cv::projectPoints(object_point_list, camera_real.rvec, camera_real.tvec, camera_real.K, camera_real.dist_coeff, image_point_real_list);
-
-    /* Convert to image points (2D) using the top view camera (virtual camera) */
-    std::vector<cv::Point2f> image_point_top_list;
-    cv::projectPoints(object_point_list, camera_top.rvec, camera_top.tvec, camera_top.K, camera_top.dist_coeff, image_point_top_list);
+    /* Convert to image points (2D) using the real camera and the top view camera (virtual camera) at once */
+    std::vector<std::vector<cv::Point2f>> image_point_list;
+    std::vector<std::vector<uint8_t>> is_visible_list;
+    camera_rig.ConvertWorld2Image(object_point_list, image_point_list, is_visible_list);
+    const std::vector<cv::Point2f>& image_point_real_list = image_point_list[0];
+    const std::vector<cv::Point2f>& image_point_top_list = image_point_list[1];
 
     /* Perspective Transform */
     cv::Mat mat_transform = cv::getPerspectiveTransform(&image_point_real_list[0], &image_point_top_list[0]);
@@ -114,13 +116,10 @@ static void loop_param()
         }
 
         cvui::text("Camera Parameter (Intrinsic)");
-        MAKE_GUI_SETTING_FLOAT(camera_real.fx(), "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
-        camera_real.fy() = camera_real.fx();
-        camera_top.fx() = camera_real.fx();
-        camera_top.fy() = camera_real.fy();
-
-        camera_real.UpdateNewCameraMatrix();
-        camera_top.UpdateNewCameraMatrix();
+        float focal_length = camera_real.fx();
+        MAKE_GUI_SETTING_FLOAT(focal_length, "Focal Length", 10.0f, "%.0Lf", 0.0f, 1000.0f);
+        camera_real.SetFocalLength(focal_length, focal_length);
+        camera_top.SetFocalLength(focal_length, focal_length);
 
         cvui::text("Top Camera Parameter (Extrinsic)");
         float pitch_deg = Rad2Deg(camera_top.rx());
@@ -236,6 +235,8 @@ int main(int argc, char* argv[])
     cv::Mat image_org = cv::imread(image_path);
 
     ResetCamera(image_org.cols, image_org.rows);
+    camera_rig.AddCamera(&camera_real);
+    camera_rig.AddCamera(&camera_top);
 
     while (true) {
         loop_main(image_org);
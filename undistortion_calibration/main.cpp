@@ -24,15 +24,14 @@ limitations under the License.
 
 #include <opencv2/opencv.hpp>
 
+#include "camera_model.h"
+#include "camera_bundle.h"
 
 /*** Macro ***/
 
 /*** Global variable ***/
 
 /*** Function ***/
-static inline float Deg2Rad(float deg) { return static_cast<float>(deg * M_PI / 180.0); }
-static inline float Rad2Deg(float rad) { return static_cast<float>(rad * 180.0 / M_PI); }
-
 int main(int argc, char *argv[])
 {
     static constexpr int32_t kHorizonalCrossCount = 7;
@@ -95,10 +94,25 @@ int main(int argc, char *argv[])
     fs << "dist_coeff" << dist_coeff;
     fs << "rvec" << rvec;
     fs << "tvec" << tvec;
-    fs << "mapx" << mapx;
-    fs << "mapy" << mapy;
     fs.release();
 
+    /* Save parameters and tables (mapx, mapy, ray table) as a binary bundle, which is loaded much faster than yaml */
+    CameraModel camera;
+    camera.SetIntrinsic(image_size.width, image_size.height,
+        static_cast<float>(K.at<double>(0, 0)), static_cast<float>(K.at<double>(1, 1)), static_cast<float>(K.at<double>(0, 2)), static_cast<float>(K.at<double>(1, 2)));
+    camera.SetDist({ static_cast<float>(dist_coeff.at<double>(0)), static_cast<float>(dist_coeff.at<double>(1)), static_cast<float>(dist_coeff.at<double>(2)),
+        static_cast<float>(dist_coeff.at<double>(3)), static_cast<float>(dist_coeff.at<double>(4)) });
+    CameraBundle::Save("calib.bin", camera, {
+        { CameraBundle::kTableUndistortMapX, 0, mapx },
+        { CameraBundle::kTableUndistortMapY, 0, mapy },
+        { CameraBundle::kTableRay, 0, camera.GetRayTable() } });
+
+    /* Load the bundle (no parse, no copy) */
+    CameraBundle bundle;
+    if (!bundle.Open("calib.bin")) return -1;
+    mapx = bundle.GetTable(CameraBundle::kTableUndistortMapX);
+    mapy = bundle.GetTable(CameraBundle::kTableUndistortMapY);
+
     for (int32_t i = 0; i < image_path_list.size(); i++) {
         cv::Mat image_chessboard = cv::imread(image_path_list[i]);
         cv::Mat image_undistorted;
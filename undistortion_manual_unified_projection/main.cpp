@@ -27,6 +27,8 @@ limitations under the License.
 #define CVUI_IMPLEMENTATION
 #include "cvui.h"
 
+#include "camera_model.h"
+
 
 /*** Macro ***/
 static constexpr char kWindowMain[] = "WindowMain";
@@ -51,10 +53,6 @@ static int32_t new_image_size_scale = 3;   /* this value should be adjusted acco
 static bool update_camera_parameter = true;
 
 /*** Function ***/
-static inline float Deg2Rad(float deg) { return static_cast<float>(deg * M_PI / 180.0); }
-static inline float Rad2Deg(float rad) { return static_cast<float>(rad * 180.0 / M_PI); }
-static void CreateUndistortMap(cv::Size undist_image_size, float f_undist, float xi, float u0_undist, float v0_undist, float f_dist, float u0_dist, float v0_dist, cv::Mat& mapx, cv::Mat& mapy);
-
 
 static void loop_main(const cv::Mat& image_org)
 {
@@ -65,14 +63,18 @@ static void loop_main(const cv::Mat& image_org)
     float f_undist = camera_parameter.focal_length;
     float u0_undist = undist_image_size.width / 2.0f;
     float v0_undist = undist_image_size.height / 2.0f;
-    float f_dist = camera_parameter.focal_length;
-    float u0_dist = image_org.cols / 2.0f;
-    float v0_dist = image_org.rows / 2.0f;
-    
+    cv::Matx33f K_undist(
+        f_undist, 0, u0_undist,
+        0, f_undist, v0_undist,
+        0, 0, 1);
+
     /* Calculate undistort map */
     static cv::Mat mapx, mapy;
     if (update_camera_parameter) {
-        CreateUndistortMap(undist_image_size, f_undist, camera_parameter.xi, u0_undist, v0_undist, f_dist, u0_dist, v0_dist, mapx, mapy);
+        CameraModelUnified camera;
+        camera.SetIntrinsic(image_org.cols, image_org.rows, camera_parameter.focal_length);    /* (u0, v0) = image center */
+        camera.SetXi(camera_parameter.xi);
+        camera.CreateUndistortMap(undist_image_size, K_undist, mapx, mapy);
         update_camera_parameter = false;
 
         /* Create undistorted image */
@@ -143,77 +145,3 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-
-/* reference: https://github.com/alexvbogdan/DeepCalib/blob/master/undistortion/undistSphIm.m */
-/* Unified projection model */
-static void CreateUndistortMap(cv::Size undist_image_size, float f_undist, float xi, float u0_undist, float v0_undist, float f_dist, float u0_dist, float v0_dist, cv::Mat& mapx, cv::Mat& mapy)
-{
-    cv::Mat grid_x(undist_image_size, CV_32F);
-    cv::Mat grid_y(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            grid_x.at<float>(y, x) = x + 0.0f;
-            grid_y.at<float>(y, x) = y + 0.0f;
-        }
-    }
-
-    cv::Mat X_Cam(undist_image_size, CV_32F);
-    cv::Mat Y_Cam(undist_image_size, CV_32F);
-    cv::Mat Z_Cam(undist_image_size, CV_32F, 1.0f);
-    X_Cam = (grid_x - u0_undist) / f_undist;
-    Y_Cam = (grid_y - v0_undist) / f_undist;
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        X_Cam.at<float>(y, x) = (grid_x.at<float>(y, x) - u0_undist) / f_undist;
-    //        Y_Cam.at<float>(y, x) = (grid_y.at<float>(y, x) - v0_undist) / f_undist;
-    //        Z_Cam.at<float>(y, x) = 1.0f;
-    //    }
-    //}
-
-    cv::Mat Alpha_Cam(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            Alpha_Cam.at<float>(y, x) = 1 / sqrtf(
-                X_Cam.at<float>(y, x) * X_Cam.at<float>(y, x)
-                + Y_Cam.at<float>(y, x) * Y_Cam.at<float>(y, x)
-                + Z_Cam.at<float>(y, x) * Z_Cam.at<float>(y, x)
-            );
-        }
-    }
-
-    cv::Mat X_Sph(undist_image_size, CV_32F);
-    cv::Mat Y_Sph(undist_image_size, CV_32F);
-    cv::Mat Z_Sph(undist_image_size, CV_32F);
-    cv::multiply(X_Cam, Alpha_Cam, X_Sph);
-    cv::multiply(Y_Cam, Alpha_Cam, Y_Sph);
-    cv::multiply(Z_Cam, Alpha_Cam, Z_Sph);
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        X_Sph.at<float>(y, x) = X_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //        Y_Sph.at<float>(y, x) = Y_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //        Z_Sph.at<float>(y, x) = Z_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //    }
-    //}
-
-    cv::Mat den(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            den.at<float>(y, x) = xi * sqrtf(
-                X_Sph.at<float>(y, x) * X_Sph.at<float>(y, x)
-                + Y_Sph.at<float>(y, x) * Y_Sph.at<float>(y, x)
-                + Z_Sph.at<float>(y, x) * Z_Sph.at<float>(y, x)
-            ) + Z_Sph.at<float>(y, x);
-        }
-    }
-
-    mapx = cv::Mat(undist_image_size, CV_32F);
-    mapy = cv::Mat(undist_image_size, CV_32F);
-    mapx = X_Sph * f_dist / den + u0_dist;
-    mapy = Y_Sph * f_dist / den + v0_dist;
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        mapx.at<float>(y, x) = (X_Sph.at<float>(y, x) * f_dist) / den.at<float>(y, x) + u0_dist;
-    //        mapy.at<float>(y, x) = (Y_Sph.at<float>(y, x) * f_dist) / den.at<float>(y, x) + v0_dist;
-    //    }
-    //}
-}